@@ -14,64 +14,1828 @@ Adapted from the code given in the EPFL MICRO-315 TP (Spring Semester 2020)
 #include <main.h>
 #include <usbcfg.h>
 
+#include <string.h>
+#include <stddef.h>
+#include <stdlib.h>
+
 #include <audio/microphone.h>
+#include <motors.h>
+#include <flash/flash.h>
 #include <audio_processing.h>
 #include <fft.h>
 #include <arm_math.h>
 
-//Defines
-#define FFT_SIZE 			1024			//Size of the buffer where the result of the FFT is stored
+//Defines
+#ifndef AUDIO_DECIMATION
+#define AUDIO_DECIMATION	1				//1 : no front-end, 4 or 8 : the samples are band-pass filtered and decimated before the FFT
+#endif
+#ifndef AUDIO_FFT_SIZE
+#define AUDIO_FFT_SIZE		(1024 / AUDIO_DECIMATION)	//Power of two from 32 to 4096, frame length at startup
+#endif
+//The frame length follows the SNR of the selected beacon between these two powers of two : the short frames
+//lower the latency when the beacon is strong, the long ones detect it further away
+#ifndef AUDIO_FFT_MIN_SIZE
+#ifdef AUDIO_Q15
+//The rounding of arm_cfft_q15 still moves the bearings of the weak beacons on the shortest frames
+#define AUDIO_FFT_MIN_SIZE	(AUDIO_FFT_SIZE / 2 >= 2 * FFT_MIN_SIZE ? AUDIO_FFT_SIZE / 2 : 2 * FFT_MIN_SIZE)
+#else
+#define AUDIO_FFT_MIN_SIZE	(AUDIO_FFT_SIZE / 4 >= 2 * FFT_MIN_SIZE ? AUDIO_FFT_SIZE / 4 : 2 * FFT_MIN_SIZE)
+#endif
+#endif
+#ifndef AUDIO_FFT_MAX_SIZE
+#define AUDIO_FFT_MAX_SIZE	(AUDIO_FFT_SIZE * 2 <= FFT_MAX_SIZE ? AUDIO_FFT_SIZE * 2 : FFT_MAX_SIZE)
+#endif
+#define FFT_SIZE 			AUDIO_FFT_SIZE	//Frame length at startup
+#define MIN_FFT_SIZE		AUDIO_FFT_MIN_SIZE
+#define MAX_FFT_SIZE		AUDIO_FFT_MAX_SIZE	//Size of the buffers where the frames and their FFT are stored
+#define SAMPLE_FREQ			16000			//[Hz] Sampling frequency of the microphones
+#define FRAME_FREQ			(SAMPLE_FREQ / AUDIO_DECIMATION)	//[Hz] Sampling frequency of the analyzed frames
+
+//The analyzed bins are derived from frequencies so that they follow FFT_SIZE (15.625Hz per bin with 1024 points)
+#ifndef AUDIO_SOURCE_HZ
+#define AUDIO_SOURCE_HZ		1000			//[Hz] Bin 64 with 1024 points, in reality best results were observed at 990hz
+#endif
+#define SOURCE_HZ			AUDIO_SOURCE_HZ	//[Hz] Frequency of the beacon tracked at startup, center of the analyzed band
+#ifndef AUDIO_BAND_HALF_WIDTH_HZ
+#define AUDIO_BAND_HALF_WIDTH_HZ	78		//[Hz] Half width of the analyzed band, it must hold all the beacons given to set_audio_beacons
+#endif
+#define BAND_HALF_WIDTH_HZ	AUDIO_BAND_HALF_WIDTH_HZ
+#define TOLERANCE_HZ		16				//[Hz] Frequency tolerance
+#define HZ_TO_BIN(hz, size)	(((hz) * (size) + FRAME_FREQ / 2) / FRAME_FREQ)	//Nearest bin of a frame of size samples
+
+//After the decimation, the Nyquist zone of FRAME_FREQ holding the beacon band is folded onto the first one.
+//The odd zones are mirrored, which also conjugates the phases
+#define NYQUIST_ZONE		(SOURCE_HZ / (FRAME_FREQ / 2))
+#define ZONE_MIRRORED		(NYQUIST_ZONE & 1)
+#define ALIAS_HZ(hz)		(ZONE_MIRRORED ? (NYQUIST_ZONE + 1) * (FRAME_FREQ / 2) - (hz) : (hz) - NYQUIST_ZONE * (FRAME_FREQ / 2))
+#define PHASE_SIGN			(ZONE_MIRRORED ? -1.0f : 1.0f)
+
+#define MIN_VALUE_THRESHOLD(size)	(10000 * (size) / 1024)	//Former fixed threshold of max_frequency, the CFAR detector keeps the noise above 1/32 of it
+#define MIN_FREQ(size)		HZ_TO_BIN(ALIAS_HZ(SOURCE_HZ) - BAND_HALF_WIDTH_HZ, size)	//We don't analyze before this index to not use resources for nothing
+#define MAX_FREQ(size)		HZ_TO_BIN(ALIAS_HZ(SOURCE_HZ) + BAND_HALF_WIDTH_HZ, size)	//We don't analyze after this index to not use resources for nothing
+#define MAX_ERROR(size)		(HZ_TO_BIN(TOLERANCE_HZ, size) > 1 ? HZ_TO_BIN(TOLERANCE_HZ, size) : 1)	//Frequency tolerance [bins]
+//The band of the short frames is widened to keep the guard and training cells of the CFAR detector on each side of the source
+#define BAND_MIN_HALF_BINS	(CFAR_GUARD_CELLS + CFAR_TRAINING_CELLS)
+
+#if (FFT_SIZE & (FFT_SIZE - 1)) || FFT_SIZE < 2 * FFT_MIN_SIZE || FFT_SIZE > FFT_MAX_SIZE
+#error "AUDIO_FFT_SIZE must be a power of two from 32 to 4096, the lengths of arm_rfft_fast_init_f32 (arm_cfft_q15 in Q15)"
+#endif
+#if (MIN_FFT_SIZE & (MIN_FFT_SIZE - 1)) || (MAX_FFT_SIZE & (MAX_FFT_SIZE - 1)) || MIN_FFT_SIZE < 2 * FFT_MIN_SIZE \
+	|| MAX_FFT_SIZE > FFT_MAX_SIZE || MIN_FFT_SIZE > FFT_SIZE || MAX_FFT_SIZE < FFT_SIZE
+#error "AUDIO_FFT_MIN_SIZE and AUDIO_FFT_MAX_SIZE must be powers of two from 32 to 4096 (arm_rfft_fast_init_f32, arm_cfft_q15 in Q15) around AUDIO_FFT_SIZE"
+#endif
+#if (SOURCE_HZ - BAND_HALF_WIDTH_HZ) / (FRAME_FREQ / 2) != (SOURCE_HZ + BAND_HALF_WIDTH_HZ) / (FRAME_FREQ / 2)
+#error "The beacon band crosses a multiple of FRAME_FREQ / 2, choose another AUDIO_DECIMATION"
+#endif
+
+//Cell-averaging CFAR detector on the power of the bins summed over the four microphones : the noise power of a bin is
+//the mean of the running noise floor of the training cells on each side of it, beyond the guard cells that hold the
+//leakage of the tone. The running floor averages the power of each bin over the frames, except around the strongest
+//bin of each beacon. The threshold assumes a white noise and has only been checked on the synthesized sources of
+//bench_audio, not on recordings of the robot, whose motors and echoes may raise the false alarms
+#define CFAR_MICS			4				//Microphones whose powers are summed
+#define CFAR_GUARD_CELLS	2				//Bins on each side of the tested one left out of its noise estimate
+#define CFAR_TRAINING_CELLS	3				//Bins averaged on each side beyond the guard cells
+#define CFAR_FLOOR_FRAMES	16				//Time constant of the running noise floor [frames]
+#define CFAR_MIN_NOISE(size)	(CFAR_MICS * (MAG_THRESHOLD(size) / 32.0f) * (MAG_THRESHOLD(size) / 32.0f))	//Lower bound of the noise power, a silent band does not make every bin a detection
+#ifndef AUDIO_CFAR_PFA
+#define AUDIO_CFAR_PFA		1e-4f			//Probability that a noise-only bin exceeds the threshold in a frame, see set_audio_false_alarm
+#endif
+
+//Kalman filter of the bearing : the frame bearings are the measurements, the variance grows with the time
+//elapsed since the last one. Time is counted in samples of the ring so that it follows the audio, not the
+//processing, whatever the frame length
+#define TRACK_PROCESS_NOISE	400.0f			//[deg^2/s] Growth of the variance without measurement (20 degrees after one second)
+#define TRACK_MEAS_STD		5.0f			//[deg] Standard deviation of the bearing of a frame of confidence 1
+#define TRACK_MIN_CONFIDENCE 0.2f			//Frames with a lower confidence do not update the tracker
+#define TRACK_GATE			3.0f			//Innovations beyond 3 standard deviations are rejected as outliers...
+#define TRACK_MAX_REJECTS	5				//...unless 5 frames in a row are rejected, then the tracker restarts from the measurement
+#define TRACK_RESET_VARIANCE 10800.0f		//[deg^2] Variance of a bearing uniform over the circle
+
+//Switches of the frame length : when the noise dominates, halving it lowers the SNR of a tone by 3dB. A strong tone
+//is limited to about 20dB by its own leakage into the training cells, whatever the length
+#ifndef AUDIO_SNR_SHORTEN_DB
+#define AUDIO_SNR_SHORTEN_DB	16.0f		//[dB] The frame is halved if the running SNR would stay above this once halved
+#endif
+#ifndef AUDIO_SNR_LENGTHEN_DB
+#define AUDIO_SNR_LENGTHEN_DB	12.0f		//[dB] The frame is doubled when the running SNR falls below this
+#endif
+#define SNR_HALVING_DB		3.0f			//[dB] SNR lost by a tone in noise when the frame is halved
+#define SNR_FRAMES			8				//Frames averaged by the running SNR, also the frames kept after a switch before the next one
+
+#ifndef AUDIO_BEARING
+#define AUDIO_BEARING		BEARING_PHASE	//Bearing estimator used at startup, see set_bearing_estimator
+#endif
+#ifndef AUDIO_DETECTION
+#define AUDIO_DETECTION		DETECTION_TONE	//Detection mode used at startup, see set_audio_detection
+#endif
+#define SPEED_OF_SOUND		343.0f			//[m/s]
+#define MIC_LR_DISTANCE		0.060f			//[m] Distance between the left and right microphones
+#define MIC_FB_DISTANCE		0.028f			//[m] Distance between the front and back microphones, from the -0.5 rad measured at 990Hz with the source in front
+#define GCC_LAG_STEPS		16				//Lags evaluated on each side of zero by the GCC-PHAT before the parabolic refinement
+#define GCC_LAG_MARGIN		1.2f			//The lags are searched up to 1.2 times the largest physical delay
+#define GCC_MAX_LAG_LR		(GCC_LAG_MARGIN * MIC_LR_DISTANCE / SPEED_OF_SOUND)	//[s]
+#define GCC_MAX_LAG_FB		(GCC_LAG_MARGIN * MIC_FB_DISTANCE / SPEED_OF_SOUND)	//[s]
+#define SRP_DIRECTIONS		72				//Directions scanned by the SRP-PHAT, every 5 degrees
+//Frequency [Hz] of the analyzed bin k before the decimation folded it (the frequency of the bin without decimation),
+//bin_hz is the width of the bins at the current frame length
+#define ZONE_BASE_HZ		(NYQUIST_ZONE * (FRAME_FREQ / 2))
+#define UNFOLDED_HZ(k)		(ZONE_MIRRORED ? ZONE_BASE_HZ + FRAME_FREQ / 2 - (k) * bin_hz : ZONE_BASE_HZ + (k) * bin_hz)
+
+#ifndef AUDIO_HOP_SIZE
+#define AUDIO_HOP_SIZE		(FFT_SIZE / 2)	//Samples between the starts of two frames, FFT_SIZE / 2 gives a 50% overlap
+#endif
+#define CHUNK_SAMPLES		160				//Samples per microphone delivered at each callback (10ms at 16kHz)
+#define FRAME_CHUNK			(CHUNK_SAMPLES / AUDIO_DECIMATION)	//Samples per microphone written in the ring at each callback
+//The ring keeps the longest frame being processed, the samples of the next hop and one chunk of margin
+#define RING_SIZE			(MAX_FFT_SIZE + AUDIO_HOP_SIZE * MAX_FFT_SIZE / FFT_SIZE + FRAME_CHUNK)
+
+#if CHUNK_SAMPLES % AUDIO_DECIMATION
+#error "AUDIO_DECIMATION must divide CHUNK_SAMPLES"
+#endif
+
+//Band-pass filter of the front-end : windowed sinc whose pass band covers the Nyquist zone of the beacon
+//except a quarter of the zone at each edge, left for the transition bands (about 3.3 * SAMPLE_FREQ / DECIM_TAPS wide)
+#define DECIM_TAPS			(16 * AUDIO_DECIMATION)
+#define DECIM_LOW_HZ		(NYQUIST_ZONE * (FRAME_FREQ / 2) + FRAME_FREQ / 8)
+#define DECIM_HIGH_HZ		((NYQUIST_ZONE + 1) * (FRAME_FREQ / 2) - FRAME_FREQ / 8)
+
+//Coded beacons : instead of a tone, the beacon repeats a code of AUDIO_CODE_PERIOD samples spread around SOURCE_HZ,
+//either a linear chirp sweeping SOURCE_HZ +- AUDIO_CODE_HALF_WIDTH_HZ or a carrier at SOURCE_HZ whose sign follows the
+//CODE_CHIPS chips of a maximal length sequence. A frame holds exactly one period, where the code appears circularly
+//shifted by its arrival time. The matched filter multiplies the spectra by the conjugate spectrum of the code and
+//brings them back to CODE_LAGS lags of the period : the power of the four microphones at the best lag is compared to
+//its mean over the other lags, and the bearing is read at this lag, before the echoes of the code arrive. The carrier of
+//a beacon is rarely exactly SOURCE_HZ and the sequence loses its correlation a fraction of a bin away, so the filter is
+//repeated for AUDIO_CODE_OFFSETS carriers around it and keeps the best one
+#ifndef AUDIO_CODE_PERIOD
+#define AUDIO_CODE_PERIOD	1024			//[samples] Period of the code at SAMPLE_FREQ (64ms)
+#endif
+#ifndef AUDIO_CODE_HALF_WIDTH_HZ
+#define AUDIO_CODE_HALF_WIDTH_HZ	200		//[Hz] Half of the sweep of the chirp
+#endif
+#define CODE_SIZE			(AUDIO_CODE_PERIOD / AUDIO_DECIMATION)	//Length of the frames of the coded beacons
+#define CODE_BAND_HALF_WIDTH_HZ	(AUDIO_CODE_HALF_WIDTH_HZ * 5 / 4)	//[Hz] Analyzed band, with the edges of the spectrum of the code
+#define CODE_MIN_FREQ		HZ_TO_BIN(ALIAS_HZ(SOURCE_HZ) - CODE_BAND_HALF_WIDTH_HZ, CODE_SIZE)
+#define CODE_MAX_FREQ		HZ_TO_BIN(ALIAS_HZ(SOURCE_HZ) + CODE_BAND_HALF_WIDTH_HZ, CODE_SIZE)
+#define CODE_LAGS			64				//Lags of the matched filter over the period, a power of two above the bins of the band
+#define CODE_GUARD_LAGS		3				//Lags on each side of the best one left out of the noise, they hold its main lobe
+#define CODE_CHIPS			15				//Chips of the sequence over the period (234Hz with the default period)
+#define CODE_SEQUENCE		0x7591			//Chip c is bit c, a set bit inverts the carrier (x^4 + x^3 + 1 from 0001)
+#ifndef AUDIO_CODE_OFFSETS
+#define AUDIO_CODE_OFFSETS	5				//Carriers tried by the matched filter, odd (+-16Hz with the default period)
+#endif
+#define CODE_OFFSET_HZ		((float)SAMPLE_FREQ / 2 / AUDIO_CODE_PERIOD)	//[Hz] Spacing of the carriers, half a bin of the code frames
+
+//The matched filter and its buffers are only built if the frame lengths include one period of the code, the other
+//builds (e.g. a shorter AUDIO_FFT_SIZE) only detect tones unless AUDIO_CODED_BEACONS is set
+#ifndef AUDIO_CODED_BEACONS
+#if (CODE_SIZE & (CODE_SIZE - 1)) || CODE_SIZE < MIN_FFT_SIZE || CODE_SIZE > MAX_FFT_SIZE
+#define AUDIO_CODED_BEACONS	0
+#else
+#define AUDIO_CODED_BEACONS	1				//Builds the detection of the coded beacons, 0 only detects tones
+#endif
+#endif
+
+#if AUDIO_CODED_BEACONS
+#if (CODE_SIZE & (CODE_SIZE - 1)) || CODE_SIZE < MIN_FFT_SIZE || CODE_SIZE > MAX_FFT_SIZE
+#error "AUDIO_CODE_PERIOD / AUDIO_DECIMATION must be a frame length between AUDIO_FFT_MIN_SIZE and AUDIO_FFT_MAX_SIZE"
+#endif
+#if CODE_MAX_FREQ - CODE_MIN_FREQ >= CODE_LAGS
+#error "The band of the coded beacons holds more bins than CODE_LAGS"
+#endif
+#if AUDIO_CODE_OFFSETS % 2 == 0
+#error "AUDIO_CODE_OFFSETS must be odd to try SOURCE_HZ itself"
+#endif
+#if (SOURCE_HZ - CODE_BAND_HALF_WIDTH_HZ) / (FRAME_FREQ / 2) != (SOURCE_HZ + CODE_BAND_HALF_WIDTH_HZ) / (FRAME_FREQ / 2)
+#error "The band of the coded beacons crosses a multiple of FRAME_FREQ / 2, lower AUDIO_CODE_HALF_WIDTH_HZ"
+#endif
+#elif AUDIO_DETECTION != DETECTION_TONE
+#error "AUDIO_DETECTION needs AUDIO_CODED_BEACONS"
+#endif
+
+#if AUDIO_HOP_SIZE < 1 || AUDIO_HOP_SIZE > FFT_SIZE
+#error "AUDIO_HOP_SIZE must be between 1 and FFT_SIZE"
+#endif
+
+//Heading of the robot given by the step counters of the motors, positive clockwise like the bearings. The bearings are
+//tracked in a frame fixed to the ground so that the frames recorded while the robot turns remain valid
+#define WHEEL_PERIMETER		130.0f			//[mm]
+#define WHEEL_DISTANCE		53.5f			//[mm] Distance between the wheels
+#define NSTEP_ONE_TURN		1000			//Steps for one turn of a wheel
+#define DEG_PER_STEP		(WHEEL_PERIMETER / NSTEP_ONE_TURN / WHEEL_DISTANCE * 180.0f / PI)	//[deg] Rotation for a difference of one step between the wheels
+//Callbacks whose heading and motor speeds are remembered, enough to cover a frame
+#define CHUNK_HISTORY		((MAX_FFT_SIZE + FRAME_CHUNK) / FRAME_CHUNK + 2)
+
+//Ego-noise of the stepper motors : a motor turning at a given step rate emits tones at the harmonics of
+//MOTOR_NOISE_HZ_PER_STEP times this rate. The bins of the analyzed band close to these tones are notched out
+//of the spectra of the frames recorded while the motors turned at that rate, except the bins where a tone beacon
+//is accepted : the beacon would be notched with the motors (e.g. the 2nd harmonic of 500 step/s on 1000Hz). Its
+//frames are then kept and flagged with motor_noise in the snapshot, their detection may come from the motors.
+//One period per step is assumed from the driver, it has not been measured on the motors of the robot
+#ifndef AUDIO_MOTOR_NOTCH
+#define AUDIO_MOTOR_NOTCH	1				//0 : the motor speeds given to set_audio_motor_speed are ignored
+#endif
+#define MOTOR_NOISE_HZ_PER_STEP	1.0f		//[Hz / (step/s)] Fundamental of the noise of a motor, one period per step
+#define MOTOR_NOTCH_HALF_WIDTH	0.75f		//[bins] Bins closer than this to a harmonic are notched, a tone between two bins removes both
+#define MOTOR_BEACON_MARGIN	1				//[bins] Bins kept beyond the frequency tolerance of a beacon, the neighbours of its interpolated peak
+#define MOTOR_SPEED_LIMIT	1100			//[step/s] The driver saturates the speeds there
+#define MOTOR_MAX_RATES		4				//Distinct step rates notched in a frame, the speed may change during the frame
+
+//Calibration of the microphones : the gain and phase offsets of each microphone are measured against beacons at a known
+//bearing, at CALIB_POINTS frequencies spread over the analyzed band. They are stored in the configuration sector of the
+//flash and turned into a correction of each analyzed bin whenever the frame length changes. The sector is reserved for
+//them, the firmware does not use the parameter storage of the library, and it is only erased if it holds nothing else
+#define CALIB_POINTS		9				//Frequencies of the analyzed band where the offsets are measured
+#define CALIB_LOW_HZ		(SOURCE_HZ - BAND_HALF_WIDTH_HZ)	//[Hz] Frequency of the first point
+#define CALIB_SPACING_HZ	(2.0f * BAND_HALF_WIDTH_HZ / (CALIB_POINTS - 1))	//[Hz] Between two points
+#define CALIB_MIN_FRAMES	20				//Detected frames needed to measure the offsets at a point
+#define CALIB_MAGIC			0x314C4143		//"CAL1", identifies a calibration record in the flash
+
+//Fixed-point pipeline (build with -DAUDIO_Q15) : the samples stay in Q15 from the ring through arm_cfft_q15.
+//arm_cfft_q15 scales the spectrum down by the frame length. The threshold keeps the scale of the former 2.14
+//magnitudes of arm_cmplx_mag_q15, half the one of the spectrum, the powers of the bins are scaled to it
+#ifdef AUDIO_Q15
+typedef q15_t audio_t;						//Type of the frames and spectra
+#define SAMPLE_STRIDE		2				//The samples are the real parts of a complex buffer
+#define SPECTRUM_SCALE(size)	(1.0f / (size))
+#define MAG_SCALE(size)		(0.5f / (size))
+#define MAG_THRESHOLD(size)	((MIN_VALUE_THRESHOLD(size) + (size)) / (2 * (size)))
+#else
+typedef float audio_t;
+#define SAMPLE_STRIDE		1
+#define SPECTRUM_SCALE(size)	1.0f
+#define MAG_SCALE(size)		1.0f
+#define MAG_THRESHOLD(size)	MIN_VALUE_THRESHOLD(size)
+#endif
+#define POWER_SCALE			((MAG_SCALE(1) / SPECTRUM_SCALE(1)) * (MAG_SCALE(1) / SPECTRUM_SCALE(1)))	//From the spectrum to the scale of the threshold
+
+#ifndef AUDIO_ESTIMATOR
+#define AUDIO_ESTIMATOR		ESTIMATOR_FFT	//Spectral estimator used at startup, see set_audio_estimator
+#endif
+
+//Bins computed by the Goertzel estimator : the analyzed band, which also contains the peak the phase is read from.
+//The arrays hold the band of the longest frames, widened like the ones of the short frames, or the one of the coded beacons
+#define TONE_BAND_BINS		(MAX_FREQ(MAX_FFT_SIZE) - MIN_FREQ(MAX_FFT_SIZE) + 2 * BAND_MIN_HALF_BINS + 1)
+#if AUDIO_CODED_BEACONS
+#define MAX_BAND_BINS		(TONE_BAND_BINS > CODE_MAX_FREQ - CODE_MIN_FREQ + 1 ? TONE_BAND_BINS : CODE_MAX_FREQ - CODE_MIN_FREQ + 1)
+#else
+#define MAX_BAND_BINS		TONE_BAND_BINS
+#endif
+
+
+//Ring buffer of interleaved samples [right, left, back, front] filled by the callback, the DSP thread
+//reads the frames from it in place
+static int16_t ring[4 * RING_SIZE];
+#ifdef AUDIO_Q15
+//Samples of the microphone being analyzed as complex numbers with a null imaginary part,
+//transformed in place into the spectrum by the complex FFT
+static q15_t spectrum[2 * MAX_FFT_SIZE];
+static q15_t* const mic_input = spectrum;
+#else
+//Real samples of the microphone being analyzed, also used as scratch by the real FFT
+static float mic_input[MAX_FFT_SIZE];
+//Spectrum of the microphone being analyzed : fft_size/2 complex numbers (real + imaginary)
+static float spectrum[MAX_FFT_SIZE];
+#endif
+//Power of each bin of the analyzed band summed over the four microphones, at the scale of the threshold. Only the
+//band is kept, the rest of the spectra is never read
+static float band_power[MAX_BAND_BINS];
+
+#if AUDIO_DECIMATION > 1
+//Coefficients of the band-pass filter, shared by the four decimators
+static float decim_coeffs[DECIM_TAPS];
+//One decimator per microphone with its state (past samples)
+static arm_fir_decimate_instance_f32 decimators[4];
+static float decim_state[4][DECIM_TAPS + CHUNK_SAMPLES - 1];
+//Samples of one microphone before and after the decimation, and the decimated chunk of the four microphones
+static float decim_input[CHUNK_SAMPLES];
+static float decim_output[FRAME_CHUNK];
+static int16_t decimated[4 * FRAME_CHUNK];
+#endif
+
+//Geometry of the frames analyzed by the DSP thread, it follows their length : bins [min_bin, max_bin] of the
+//analyzed band of width bin_hz [Hz], frequency tolerance [bins] and lower bound of the CFAR noise
+static uint16_t fft_size = FFT_SIZE;
+static uint16_t min_bin, max_bin, band_bins;
+static uint16_t max_error;
+static float bin_hz = (float)FRAME_FREQ / FFT_SIZE;
+static float cfar_min_noise;
+//FFT of the frames at their current length, resolved once by set_frame_geometry rather than at each call
+#ifdef AUDIO_Q15
+static const arm_cfft_instance_q15* cfft_instance;
+#else
+static arm_rfft_fast_instance_f32 rfft_instance;
+#endif
+
+//Analyzed band of the spectrum of each microphone (complex values), kept for the GCC-PHAT
+static float band_values[4][2 * MAX_BAND_BINS];
+//Order of the microphones in the computations on the pairs : the pairs are (0, 1) left-right and (2, 3) front-back
+static const uint8_t pair_mics[4] = {MIC_LEFT, MIC_RIGHT, MIC_FRONT, MIC_BACK};
+
+//Steering table of the SRP-PHAT : for each direction, the rotations compensating the delay of the left and
+//front microphones at the first analyzed bin and between two consecutive bins, as (cos, sin) pairs.
+//The right and back microphones are opposite, their rotations are the conjugates
+static float srp_steering[SRP_DIRECTIONS][8];
+
+//Scratch buffers of the GCC-PHAT and the SRP-PHAT, too large for the stack of the DSP thread
+static float cross[2 * MAX_BAND_BINS];
+static float bin_weight[MAX_BAND_BINS];
+static float corr[AUDIO_MAX_BEACONS][2 * GCC_LAG_STEPS + 1];
+static float phat[4][2 * MAX_BAND_BINS];
+static float srp_power[AUDIO_MAX_BEACONS][SRP_DIRECTIONS];
+
+//Running noise floor of the bins of the analyzed band and threshold of the CFAR detector on the ratio of the power
+//of a bin to its noise estimate
+static float noise_floor[MAX_BAND_BINS];
+static uint8_t floor_frames[MAX_BAND_BINS];			//Frames averaged in each bin of the floor, up to CFAR_FLOOR_FRAMES
+static float cfar_alpha;
+
+//Matched filter of the coded beacons : conjugate spectrum of the code over the analyzed band, normalized to a unit
+//energy so that the noise of a lag has the power of the noise of a bin, output of each microphone (indexed by MIC_xxx)
+//at each lag, running mean over the frames of the power of the lags beyond the main lobe like the noise floor of the
+//CFAR detector, and threshold of the power at the best lag over this mean
+#if AUDIO_CODED_BEACONS
+static float code_ref[AUDIO_CODE_OFFSETS][2 * MAX_BAND_BINS];
+static float code_lags[4][2 * CODE_LAGS];
+static const arm_cfft_instance_f32* code_cfft;		//FFT between the bins and the lags, resolved by code_init
+static float code_offset_hz;						//[Hz] Offset of the carrier retained in the last frame
+static float code_floor;
+static uint8_t code_frames;
+static float code_alpha;
+#endif
+
+//Calibration record as stored in the flash
+typedef struct {
+	uint32_t magic;					//CALIB_MAGIC
+	uint16_t source_hz;				//[Hz] Band covered by the points, the record is ignored by a firmware analyzing another band
+	uint16_t half_width_hz;			//[Hz]
+	float correction[CALIB_POINTS][4][2];	//Complex factor of each microphone (indexed by MIC_xxx) at each point, before the decimation folded the band
+	uint32_t checksum;				//See calibration_checksum
+} audio_calibration_t;
+
+//First byte of the flash sector reserved for the configuration by the linker script of the e-puck2 library
+extern uint8_t _config_start[];
+
+//Calibration in use and its correction of each analyzed bin at the current frame length, as complex factors of the spectra
+//(with the phases of the folded band)
+static audio_calibration_t calibration;
+static bool calibrated = FALSE;
+static float calib_factor[4][2 * MAX_BAND_BINS];
+//Calibration saved by save_audio_calibration, applied by the DSP thread before the next frame
+static audio_calibration_t pending_calibration;
+static bool calib_pending = FALSE;
+//Measurement started by start_audio_calibration : bearing [deg] of the beacons and, at each point, sums of the phase
+//offset (as unit vectors weighted by the magnitudes) and of the magnitude of each microphone over the detected frames
+static bool calibrating = FALSE;
+static float calib_bearing;
+static float calib_sum[CALIB_POINTS][4][2];
+static float calib_mag[CALIB_POINTS][4];
+static uint16_t calib_frames[CALIB_POINTS];
+
+//Beacon tracked by audio_processing : detection and bearing of the last frame, and bearing tracker
+typedef struct {
+	uint16_t hz;					//[Hz] Frequency of the beacon
+	uint16_t bin;					//Bin of the beacon in the spectrum
+	uint8_t status;					//NO_AUDIO or AUDIO_DETECTED in the last frame
+	float frame_angle;				//[deg] Bearing of the last frame given by the GCC-PHAT or the SRP-PHAT
+	float confidence;				//Confidence of the bearing of the last frame
+	float peak_hz;					//[Hz] Interpolated frequency of the peak in the last frame where the beacon was detected
+	float snr_db;					//[dB] Signal to noise ratio of the strongest bin of the beacon in the last frame
+	bool motor_noise;				//A harmonic of the motors fell on the bins of the beacon in the last frame, they were not notched
+	float track_angle;				//[deg] Tracked bearing at the last update, in the ground frame (bearing + heading of the robot)
+	float track_variance;			//[deg^2] Its variance
+	uint32_t track_time;			//Samples written in the ring at the end of the frame of the last update
+	uint32_t track_first;			//Samples written in the ring at the last reset, the frames starting before are not accepted
+	uint8_t track_rejects;			//Number of consecutive frames rejected by the gate
+} beacon_t;
+
+//Tracked beacons and their number. Each bin of the analyzed band belongs to the nearest beacon, the peak of
+//a beacon is searched in its bins and its GCC-PHAT and SRP-PHAT only use them
+static beacon_t beacons[AUDIO_MAX_BEACONS];
+static uint8_t nb_beacons = 0;
+static uint8_t bin_owner[MAX_BAND_BINS];
+//Beacons requested by set_audio_beacons, applied by the DSP thread before the next frame (0 if none)
+static uint16_t pending_hz[AUDIO_MAX_BEACONS];
+static uint8_t nb_pending = 0;
+//Beacon reported by get_angle, get_audio_status, get_audio_snapshot...
+static uint8_t active_beacon = 0;
+//Number of FFT frames processed since startup
+static uint32_t frame_count = 0;
+//Counters and timings of the DSP thread
+static audio_stats_t stats;
+//Spectral estimator in use
+static uint8_t estimator = AUDIO_ESTIMATOR;
+//Bearing estimator in use
+static uint8_t bearing = AUDIO_BEARING;
+//Detection mode requested by set_audio_detection, and the one of the current geometry
+static volatile uint8_t detection = AUDIO_DETECTION;
+static uint8_t frame_detection = DETECTION_TONE;
+
+//Ring state : total number of samples written, start (in the ring) and length of the frame handed to the DSP thread,
+//value of the total at the end of that frame and whether the DSP thread is still working on it
+static uint32_t written = 0;
+static uint16_t frame_start = 0;
+static uint16_t frame_length = FFT_SIZE;
+static uint32_t frame_end = 0;
+static bool dsp_busy = FALSE;
+//Frame length chosen by the DSP thread for the next frames, length forced by set_audio_frame_length (0 if it follows
+//the SNR) and shortest length whose bins separate the tracked beacons
+static volatile uint16_t next_size = FFT_SIZE;
+static volatile uint16_t forced_size = 0;
+static uint16_t shortest_size = MIN_FFT_SIZE;
+//Running SNR [dB] of the selected beacon at the current frame length and number of frames it averages
+static float running_snr_db = 0;
+static uint8_t snr_frames = 0;
+//Heading of the robot [deg] at the middle of the frame handed to the DSP thread, and at the end of the last callbacks
+static float frame_heading = 0;
+static float heading_history[CHUNK_HISTORY];
+//Speeds [step/s] given to set_audio_motor_speed, at the end of the last callbacks, and step rates during the frame handed to the DSP thread
+static volatile int16_t motor_speed[2] = {0, 0};
+static int16_t speed_history[CHUNK_HISTORY][2];
+static uint16_t frame_rates[MOTOR_MAX_RATES];
+static uint8_t frame_nb_rates = 0;
+//Bins of the analyzed band notched in the current frame
+static bool notched[MAX_BAND_BINS];
+
+//Semaphore for alerting the DSP thread when a frame is ready
+static BSEMAPHORE_DECL(frame_ready_sem, TRUE);
+
+//Double-buffered snapshot of the results of each beacon : the writers fill the buffer the readers are not using,
+//then publish it by incrementing snapshot_seq, whose parity selects the current buffer. A reader never waits
+//for a writer, it only copies again if a publication happened during its copy
+static audio_snapshot_t snapshots[2][AUDIO_MAX_BEACONS];
+static volatile uint32_t snapshot_seq = 0;
+//Semaphore signaled after each processed frame, for the thread waiting in wait_audio_frame
+static BSEMAPHORE_DECL(frame_done_sem, TRUE);
+
+
+/*
+*	Simple function used to detect the highest value in the bins of each beacon, from the power of the analyzed band
+*	summed over the four microphones by keep_band. The highest bin is kept as the peak of the beacon if the CFAR
+*	detector accepts it.
+*	Writes in peaks the index of the peak of each beacon ((uint16_t)-1 if none) and in snr the ratio of the power of
+*	its highest bin to the noise estimate
+*/
+void max_frequency(uint16_t* peaks, float* snr)
+{
+	//Bins left out of the noise estimate, static for the stack of the DSP thread
+	static bool guarded[MAX_BAND_BINS];
+	const float* power = band_power;
+	float max_power[AUDIO_MAX_BEACONS];
+
+	for(uint8_t b = 0 ; b < nb_beacons ; b++)
+	{
+		max_power[b] = 0;
+		peaks[b] = (uint16_t)-1;
+		snr[b] = 0;
+	}
+
+	//search for the highest peak, on each run of consecutive bins of a beacon. The notched bins have no power
+	for(uint16_t k = 0 ; k < band_bins ; )
+	{
+		uint8_t b = bin_owner[k];
+		uint16_t run = 1;
+		float value;
+		uint32_t index;
+
+		while(k + run < band_bins && bin_owner[k + run] == b){run++;}
+		arm_max_f32(&band_power[k], run, &value, &index);
+		if(value > max_power[b]){
+			max_power[b] = value;
+			peaks[b] = min_bin + k + index;
+		}
+		k += run;
+	}
+	memcpy(guarded, notched, sizeof(guarded));
+
+	//The bins around the peak of every beacon may hold a tone, they are left out of the noise like the notched bins
+	for(uint8_t b = 0 ; b < nb_beacons ; b++)
+	{
+		if(peaks[b] == (uint16_t)-1){continue;}
+		for(int16_t g = peaks[b] - min_bin - CFAR_GUARD_CELLS ; g <= peaks[b] - min_bin + CFAR_GUARD_CELLS ; g++)
+		{
+			if(g >= 0 && g < band_bins){guarded[g] = TRUE;}
+		}
+	}
+
+	//Running noise floor. Until CFAR_FLOOR_FRAMES frames have been averaged it is the plain mean of the frames,
+	//so that the first frame is already its own noise floor
+	for(uint16_t k = 0 ; k < band_bins ; k++)
+	{
+		if(guarded[k]){continue;}
+		if(floor_frames[k] < CFAR_FLOOR_FRAMES){floor_frames[k]++;}
+		noise_floor[k] += (power[k] - noise_floor[k]) / floor_frames[k];
+	}
+
+	for(uint8_t b = 0 ; b < nb_beacons ; b++)
+	{
+		if(peaks[b] == (uint16_t)-1){continue;}
+		int16_t k = peaks[b] - min_bin;
+
+		//Training cells on each side of the guard cells, inside the band and away from the other beacons
+		float noise = 0;
+		uint8_t count = 0;
+		for(int16_t t = CFAR_GUARD_CELLS + 1 ; t <= CFAR_GUARD_CELLS + CFAR_TRAINING_CELLS ; t++)
+		{
+			if(k - t >= 0 && !guarded[k - t] && floor_frames[k - t]){noise += noise_floor[k - t]; count++;}
+			if(k + t < band_bins && !guarded[k + t] && floor_frames[k + t]){noise += noise_floor[k + t]; count++;}
+		}
+		noise = count ? noise / count : cfar_min_noise;
+		if(noise < cfar_min_noise){noise = cfar_min_noise;}
+
+		snr[b] = power[k] / noise;
+		if(snr[b] <= cfar_alpha){peaks[b] = (uint16_t)-1;}
+	}
+}
+
+
+//Wraps a phase difference to [-PI, PI]
+static float wrap_phase(float x)
+{
+	if(x > PI){return x - 2.0f * PI;}
+	if(x < -PI){return x + 2.0f * PI;}
+	return x;
+}
+
+
+#if AUDIO_CODED_BEACONS
+//Sample n of one period of the code of the coded beacons at FRAME_FREQ, of unit amplitude, its carrier moved by offset_hz
+static float code_sample(uint16_t n, float offset_hz)
+{
+	float t = (float)n / FRAME_FREQ;
+	float cycles;
+
+	if(frame_detection == DETECTION_CHIRP)
+	{
+		//The frequency sweeps the band linearly over the period
+		cycles = (SOURCE_HZ - AUDIO_CODE_HALF_WIDTH_HZ + offset_hz) * t + AUDIO_CODE_HALF_WIDTH_HZ * t * t * FRAME_FREQ / CODE_SIZE;
+		return cosf(2.0f * PI * (cycles - floorf(cycles)));
+	}
+	cycles = (SOURCE_HZ + offset_hz) * t;
+	float x = cosf(2.0f * PI * (cycles - floorf(cycles)));
+	return ((CODE_SEQUENCE >> (n * CODE_CHIPS / CODE_SIZE)) & 1) ? -x : x;
+}
+
+
+/*
+*	Fills code_ref with the conjugate spectra of the code over the analyzed band, normalized to a unit energy, for each
+*	offset of its carrier. The code is sampled at FRAME_FREQ like the frames, so that it is folded by the decimation
+*	like them. The rotation of each bin follows the samples by recurrence, the outputs of the matched filter hold them meanwhile
+*/
+static void code_init(void)
+{
+	float* rotation = code_lags[0];
+	float* step = code_lags[1];
+
+	code_cfft = get_cfft_instance(CODE_LAGS);
+	for(uint8_t h = 0 ; h < AUDIO_CODE_OFFSETS ; h++)
+	{
+		float* ref = code_ref[h];
+		float offset_hz = (h - AUDIO_CODE_OFFSETS / 2) * CODE_OFFSET_HZ;
+		float energy = 0;
+
+		for(uint16_t k = 0 ; k < band_bins ; k++)
+		{
+			ref[2*k] = ref[2*k+1] = 0;
+			rotation[2*k] = 1;
+			rotation[2*k+1] = 0;
+			step[2*k] = cosf(2.0f * PI * (min_bin + k) / CODE_SIZE);
+			step[2*k+1] = -sinf(2.0f * PI * (min_bin + k) / CODE_SIZE);
+		}
+		for(uint16_t n = 0 ; n < CODE_SIZE ; n++)
+		{
+			float x = code_sample(n, offset_hz);
+			for(uint16_t k = 0 ; k < band_bins ; k++)
+			{
+				ref[2*k] += x * rotation[2*k];
+				ref[2*k+1] += x * rotation[2*k+1];
+				float re = rotation[2*k] * step[2*k] - rotation[2*k+1] * step[2*k+1];
+				rotation[2*k+1] = rotation[2*k] * step[2*k+1] + rotation[2*k+1] * step[2*k];
+				rotation[2*k] = re;
+			}
+		}
+		for(uint16_t k = 0 ; k < 2 * band_bins ; k++){energy += ref[k] * ref[k];}
+		for(uint16_t k = 0 ; k < band_bins ; k++)
+		{
+			ref[2*k] /= sqrtf(energy);
+			ref[2*k+1] /= -sqrtf(energy);
+		}
+	}
+	code_offset_hz = 0;
+}
+
+
+/*
+*	Multiplies the band of each microphone by the conjugate spectrum ref of the code and transforms it into the
+*	CODE_LAGS lags of code_lags, whose powers summed over the microphones are written in power.
+*	Returns the lag of the largest power
+*/
+static uint16_t correlate_code(const float* ref, float* power)
+{
+	uint16_t best = 0;
+
+	memset(power, 0, CODE_LAGS * sizeof(float));
+	for(uint8_t m = 0 ; m < 4 ; m++)
+	{
+		const float* value = band_values[pair_mics[m]];
+		float* lags = code_lags[m];
+
+		memset(lags, 0, sizeof(code_lags[m]));
+		for(uint16_t k = 0 ; k < band_bins ; k++)
+		{
+			lags[2*k] = value[2*k] * ref[2*k] - value[2*k+1] * ref[2*k+1];
+			lags[2*k+1] = value[2*k] * ref[2*k+1] + value[2*k+1] * ref[2*k];
+		}
+		//The forward transform gives the lags backwards, which does not matter for their powers and phases
+		arm_cfft_f32(code_cfft, lags, 0, 1);
+		for(uint16_t l = 0 ; l < CODE_LAGS ; l++)
+		{
+			power[l] += lags[2*l] * lags[2*l] + lags[2*l+1] * lags[2*l+1];
+		}
+	}
+	for(uint16_t l = 1 ; l < CODE_LAGS ; l++)
+	{
+		if(power[l] > power[best]){best = l;}
+	}
+	return best;
+}
+
+
+/*
+*	Matched filter of the coded beacon, which is the selected beacon : the band of each microphone is multiplied by
+*	code_ref and transformed into CODE_LAGS lags of the period, whose powers are summed over the microphones. This is
+*	done for each offset of the carrier, the best lag of all of them is kept with the lags of its offset. The code
+*	is detected if the power of the best lag exceeds code_alpha times the running mean of the lags beyond the guard lags.
+*	Writes the bin of the beacon in peaks if it is detected ((uint16_t)-1 otherwise and for the other beacons), the
+*	ratio of the best lag to the noise in snr, and the phase differences between the left-right and front-back
+*	microphones at the best lag in diff_lr and diff_fb. The bands of the microphones are then gated to the best lag
+*/
+static void match_code(uint16_t* peaks, float* snr, float* diff_lr, float* diff_fb)
+{
+	static float power[CODE_LAGS];
+	float y[4], x[4], phase[4];
+	uint16_t best = 0;
+	uint8_t best_offset = 0;
+	float best_power = -1;
+
+	for(uint8_t b = 0 ; b < nb_beacons ; b++)
+	{
+		peaks[b] = (uint16_t)-1;
+		snr[b] = 0;
+	}
+
+	for(uint8_t h = 0 ; h < AUDIO_CODE_OFFSETS ; h++)
+	{
+		uint16_t l = correlate_code(code_ref[h], power);
+		if(power[l] > best_power)
+		{
+			best = l;
+			best_offset = h;
+			best_power = power[l];
+		}
+	}
+	//The lags of the best offset are computed again, unless it was the last one
+	if(best_offset != AUDIO_CODE_OFFSETS - 1){correlate_code(code_ref[best_offset], power);}
+	code_offset_hz = (best_offset - AUDIO_CODE_OFFSETS / 2) * CODE_OFFSET_HZ;
+
+	//Noise from the lags beyond the main lobe, the lags have the scale of the spectrum, not the one of the threshold
+	float noise = 0;
+	float min_noise = cfar_min_noise / POWER_SCALE;
+	for(uint16_t l = 0 ; l < CODE_LAGS ; l++)
+	{
+		uint16_t distance = (l > best) ? l - best : best - l;
+		if(distance > CODE_GUARD_LAGS && CODE_LAGS - distance > CODE_GUARD_LAGS){noise += power[l];}
+	}
+	if(code_frames < CFAR_FLOOR_FRAMES){code_frames++;}
+	code_floor += (noise / (CODE_LAGS - 2 * CODE_GUARD_LAGS - 1) - code_floor) / code_frames;
+	noise = (code_floor > min_noise) ? code_floor : min_noise;
+
+	snr[active_beacon] = power[best] / noise;
+	if(snr[active_beacon] <= code_alpha){return;}
+	peaks[active_beacon] = beacons[active_beacon].bin;
+
+	for(uint8_t m = 0 ; m < 4 ; m++)
+	{
+		x[m] = code_lags[m][2*best];
+		y[m] = code_lags[m][2*best+1];
+	}
+	atan2_approx(y, x, phase, 4);
+	//Conjugated back if the band was mirrored by the decimation
+	*diff_lr = PHASE_SIGN * wrap_phase(phase[0] - phase[1]);
+	*diff_fb = PHASE_SIGN * wrap_phase(phase[2] - phase[3]);
+
+	//The band of each microphone is replaced by the main lobe alone brought back to the bins, without the echoes and
+	//most of the noise. Its cross spectra only differ from the ones of the microphones by the power spectrum of the
+	//code, the GCC-PHAT and the SRP-PHAT read the same phases. The transform of the conjugate inverts the first one
+	for(uint8_t m = 0 ; m < 4 ; m++)
+	{
+		float* lags = code_lags[m];
+		float* value = band_values[pair_mics[m]];
+
+		for(uint16_t l = 0 ; l < CODE_LAGS ; l++)
+		{
+			uint16_t distance = (l > best) ? l - best : best - l;
+			bool lobe = (distance <= CODE_GUARD_LAGS || CODE_LAGS - distance <= CODE_GUARD_LAGS);
+			lags[2*l] = lobe ? lags[2*l] : 0;
+			lags[2*l+1] = lobe ? -lags[2*l+1] : 0;
+		}
+		arm_cfft_f32(code_cfft, lags, 0, 1);
+		for(uint16_t k = 0 ; k < band_bins ; k++)
+		{
+			value[2*k] = lags[2*k];
+			value[2*k+1] = -lags[2*k+1];
+		}
+	}
+}
+#endif
+
+
+/*
+*	Computes with the Goertzel algorithm only the bins used by max_frequency and the phase extraction,
+*	and stores them at their place in the spectrum.
+*	The rest of the processing is then the same as with the full FFT.
+*/
+static void goertzel_estimate(audio_t* input)
+{
+	static uint16_t bins[MAX_BAND_BINS];
+	static float values[2 * MAX_BAND_BINS];
+	uint16_t nb_bins = 0;
+
+	for(uint16_t k = min_bin ; k <= max_bin ; k++){bins[nb_bins++] = k;}
+
+#ifdef AUDIO_Q15
+	doGoertzel_q15(fft_size, input, SAMPLE_STRIDE, bins, nb_bins, values);
+#else
+	doGoertzel(fft_size, input, SAMPLE_STRIDE, bins, nb_bins, values);
+#endif
+
+	//Complex values, in Q15 the samples are overwritten but they have all been read
+	for(uint16_t b = 0 ; b < nb_bins ; b++)
+	{
+		spectrum[2*bins[b]] = (audio_t)(SPECTRUM_SCALE(fft_size) * values[2*b]);
+		spectrum[2*bins[b]+1] = (audio_t)(SPECTRUM_SCALE(fft_size) * values[2*b+1]);
+	}
+}
+
+
+/*
+*	Marks in notched the bins of the analyzed band close to the harmonics of the noise of the motors turning
+*	at the nb step rates of rates. Only the harmonics near the band before the decimation folded it are considered.
+*	The bins where a tone beacon is accepted are not notched, the beacon is flagged with motor_noise instead
+*/
+static void motor_notch(const uint16_t* rates, uint8_t nb)
+{
+	float low = (ZONE_MIRRORED ? UNFOLDED_HZ(max_bin) : UNFOLDED_HZ(min_bin)) - bin_hz;
+	float high = (ZONE_MIRRORED ? UNFOLDED_HZ(min_bin) : UNFOLDED_HZ(max_bin)) + bin_hz;
+
+	memset(notched, 0, sizeof(notched));
+	for(uint8_t b = 0 ; b < nb_beacons ; b++){beacons[b].motor_noise = FALSE;}
+#if AUDIO_MOTOR_NOTCH
+	for(uint8_t r = 0 ; r < nb ; r++)
+	{
+		float fundamental = MOTOR_NOISE_HZ_PER_STEP * rates[r];
+		for(float hz = ceilf(low / fundamental) * fundamental ; hz <= high ; hz += fundamental)
+		{
+			float bin = ALIAS_HZ(hz) / bin_hz;
+			for(int16_t k = (int16_t)ceilf(bin - MOTOR_NOTCH_HALF_WIDTH) ; k <= bin + MOTOR_NOTCH_HALF_WIDTH ; k++)
+			{
+				if(k < min_bin || k > max_bin){continue;}
+				//The coded beacons spread over the band, a few notched bins only lower their correlation
+				uint8_t b = bin_owner[k - min_bin];
+				if(frame_detection == DETECTION_TONE && abs(k - beacons[b].bin) <= max_error + MOTOR_BEACON_MARGIN)
+				{
+					beacons[b].motor_noise = TRUE;
+					continue;
+				}
+				notched[k - min_bin] = TRUE;
+			}
+		}
+	}
+#else
+	(void)rates;
+	(void)nb;
+	(void)low;
+	(void)high;
+#endif
+}
+
+
+//Removes the notched bins from the spectrum of the microphone being analyzed
+static void apply_notch(void)
+{
+	for(uint16_t k = 0 ; k < band_bins ; k++)
+	{
+		if(!notched[k]){continue;}
+		spectrum[2 * (min_bin + k)] = 0;
+		spectrum[2 * (min_bin + k) + 1] = 0;
+	}
+}
+
+
+//Computes the spectrum of the microphone being analyzed with the selected estimator
+static void analyze_mic(audio_t* input)
+{
+	if(estimator == ESTIMATOR_GOERTZEL)
+	{
+		//Only the analyzed bins
+		goertzel_estimate(input);
+	}
+	else
+	{
+#ifdef AUDIO_Q15
+		//Fixed-point complex FFT in place, the input becomes the spectrum
+		arm_cfft_q15(cfft_instance, input, 0, 1);
+#else
+		//Real FFT processing, the input is used as scratch. Bin 0 mixes the DC and fft_size/2 bins but is never analyzed
+		arm_rfft_fast_f32(&rfft_instance, input, spectrum, 0);
+#endif
+	}
+}
+
+
+//Deinterleaves the fft_size samples of one microphone starting at index start of the ring
+static void extract_mic(uint16_t start, uint8_t mic, audio_t* input)
+{
+	uint16_t first = RING_SIZE - start;
+	if(first > fft_size){first = fft_size;}
+
+#ifdef AUDIO_Q15
+	//Null imaginary parts, the previous FFT left its output in the buffer
+	memset(input, 0, 2 * fft_size * sizeof(q15_t));
+#endif
+	for(uint16_t i = 0 ; i < first ; i++)
+	{
+		input[SAMPLE_STRIDE*i] = (audio_t)ring[4*(start + i) + mic];
+	}
+	//Wraps around the end of the ring
+	for(uint16_t i = first ; i < fft_size ; i++)
+	{
+		input[SAMPLE_STRIDE*i] = (audio_t)ring[4*(i - first) + mic];
+	}
+}
+
+
+/*
+*	Keeps the analyzed band of the spectrum of microphone mic, corrected by the calibration if correct is set, and adds
+*	the power of its bins to band_power in the same pass
+*/
+static void keep_band(uint8_t mic, bool correct)
+{
+	float* value = band_values[mic];
+	const float* factor = calib_factor[mic];
+
+	for(uint16_t k = 0 ; k < band_bins ; k++)
+	{
+		float re = (float)spectrum[2 * (min_bin + k)];
+		float im = (float)spectrum[2 * (min_bin + k) + 1];
+		//Offsets of the microphone
+		if(correct)
+		{
+			float corrected = re * factor[2*k] - im * factor[2*k+1];
+			im = re * factor[2*k+1] + im * factor[2*k];
+			re = corrected;
+		}
+		value[2*k] = re;
+		value[2*k+1] = im;
+		band_power[k] += POWER_SCALE * (re * re + im * im);
+	}
+}
+
+
+//Checksum of a calibration record, a rotating sum of the words before it
+static uint32_t calibration_checksum(const audio_calibration_t* record)
+{
+	const uint32_t* words = (const uint32_t*)record;
+	uint32_t sum = 0;
+
+	for(uint16_t i = 0 ; i < offsetof(audio_calibration_t, checksum) / sizeof(uint32_t) ; i++)
+	{
+		sum = ((sum << 1) | (sum >> 31)) + words[i];
+	}
+	return ~sum;
+}
+
+
+/*
+*	Returns TRUE if the configuration sector can be erased for a new record : the space of the record is either erased
+*	or starts with CALIB_MAGIC. Data written there by anything else is never erased
+*/
+static bool calibration_sector_free(void)
+{
+	if(((const audio_calibration_t*)_config_start)->magic == CALIB_MAGIC){return TRUE;}
+	for(uint16_t i = 0 ; i < sizeof(audio_calibration_t) ; i++)
+	{
+		if(_config_start[i] != 0xFF){return FALSE;}
+	}
+	return TRUE;
+}
+
+
+//Copies the calibration record of the flash to dest, returns FALSE if there is none for the analyzed band
+static bool read_calibration(audio_calibration_t* dest)
+{
+	memcpy(dest, _config_start, sizeof(*dest));
+	return dest->magic == CALIB_MAGIC && dest->source_hz == SOURCE_HZ && dest->half_width_hz == BAND_HALF_WIDTH_HZ
+			&& dest->checksum == calibration_checksum(dest);
+}
+
+
+/*
+*	Fills the correction of each analyzed bin at the current frame length from the calibration in use, interpolated
+*	between its points. The bins beyond the first or last point take its correction
+*/
+static void calibration_table(void)
+{
+	for(uint16_t k = 0 ; k < band_bins ; k++)
+	{
+		float x = (UNFOLDED_HZ(min_bin + k) - CALIB_LOW_HZ) / CALIB_SPACING_HZ;
+		if(x < 0){x = 0;}
+		if(x > CALIB_POINTS - 1){x = CALIB_POINTS - 1;}
+		uint8_t p = (x < CALIB_POINTS - 1) ? (uint8_t)x : CALIB_POINTS - 2;
+		float frac = x - p;
+
+		for(uint8_t mic = 0 ; mic < 4 ; mic++)
+		{
+			const float* low = calibration.correction[p][mic];
+			const float* high = calibration.correction[p + 1][mic];
+			float re = low[0] + frac * (high[0] - low[0]);
+			float im = low[1] + frac * (high[1] - low[1]);
+			//Conjugated if the band was mirrored by the decimation, like the phases
+			calib_factor[mic][2*k] = re;
+			calib_factor[mic][2*k+1] = PHASE_SIGN * im;
+		}
+	}
+}
+
+
+/*
+*	Delays [s] of the left and front microphones for a source at the bearing theta [rad] (positive to the right), the
+*	right and back microphones have the opposite ones. The delay of a microphone at position (x forward, y to the left)
+*	is (x cos(theta) - y sin(theta)) / SPEED_OF_SOUND, the convention of the phase differences
+*/
+static void mic_delays(float theta, float* delay_left, float* delay_front)
+{
+	*delay_left = -0.5f * MIC_LR_DISTANCE * sinf(theta) / SPEED_OF_SOUND;
+	*delay_front = 0.5f * MIC_FB_DISTANCE * cosf(theta) / SPEED_OF_SOUND;
+}
+
+
+/*
+*	Adds the offsets of the microphones at the peak bin (frequency hz) of a beacon to the measurement of the calibration.
+*	The phase expected at each microphone for a source at calib_bearing is removed, the microphones are then compared
+*	to their mean
+*/
+static void accumulate_calibration(uint16_t bin, float hz)
+{
+	float delay_left, delay_front;
+	mic_delays(calib_bearing * PI / 180.0f, &delay_left, &delay_front);
+	const float delays[4] = {delay_left, -delay_left, delay_front, -delay_front};
+	float z[4][2], ref_re = 0, ref_im = 0;
+	int16_t p = (int16_t)lrintf((hz - CALIB_LOW_HZ) / CALIB_SPACING_HZ);
+
+	if(p < 0 || p >= CALIB_POINTS){return;}
+	for(uint8_t m = 0 ; m < 4 ; m++)
+	{
+		const float* value = &band_values[pair_mics[m]][2 * (bin - min_bin)];
+		float im = PHASE_SIGN * value[1];
+		//The microphone delayed by d has the phase -2 PI hz d
+		float w = 2.0f * PI * hz * delays[m];
+		float c = cosf(w), s = sinf(w);
+		z[m][0] = value[0] * c - im * s;
+		z[m][1] = value[0] * s + im * c;
+		ref_re += z[m][0];
+		ref_im += z[m][1];
+	}
+	float norm = sqrtf(ref_re * ref_re + ref_im * ref_im);
+	if(norm == 0){return;}
+
+	//Offset and magnitude of each microphone, computed before the lock which only covers the sums
+	float offset[4][2], mag[4];
+	for(uint8_t m = 0 ; m < 4 ; m++)
+	{
+		offset[m][0] = (z[m][0] * ref_re + z[m][1] * ref_im) / norm;
+		offset[m][1] = (z[m][1] * ref_re - z[m][0] * ref_im) / norm;
+		mag[m] = sqrtf(z[m][0] * z[m][0] + z[m][1] * z[m][1]);
+	}
+
+	chSysLock();
+	//save_audio_calibration stopped the measurement during the frame
+	if(calibrating)
+	{
+		for(uint8_t m = 0 ; m < 4 ; m++)
+		{
+			calib_sum[p][pair_mics[m]][0] += offset[m][0];
+			calib_sum[p][pair_mics[m]][1] += offset[m][1];
+			calib_mag[p][pair_mics[m]] += mag[m];
+		}
+		calib_frames[p]++;
+	}
+	chSysUnlock();
+}
+
+
+/*
+*	GCC-PHAT of two microphones over the analyzed band : the cross spectrum is normalized (phase transform),
+*	its correlation is evaluated on GCC_LAG_STEPS lags on each side of zero up to max_lag and the best lag
+*	is refined by a parabola. Each bin is weighted by the magnitude of the cross spectrum, so that the noise-only
+*	bins and the leakage of the other beacons do not outweigh the bins of the beacon. The correlation of each
+*	beacon only sums its bins, all the beacons are computed in one pass over the band.
+*	Writes for each beacon the lag [s] in lag, positive when the phase of a is ahead of the one of b like the
+*	phase differences of process_frame, and the weighted correlation at this lag in peak, 1 when all the bins agree
+*/
+static void gcc_phat(const float* a, const float* b, float max_lag, float* lag, float* peak)
+{
+	float* gcc_weight = bin_weight;
+	float total[AUDIO_MAX_BEACONS] = {0};
+
+	//Cross spectrum a * conj(b) reduced to its phase, conjugated back if the band was mirrored by the decimation
+	for(uint16_t k = 0 ; k < band_bins ; k++)
+	{
+		float re = a[2*k] * b[2*k] + a[2*k+1] * b[2*k+1];
+		float im = PHASE_SIGN * (a[2*k+1] * b[2*k] - a[2*k] * b[2*k+1]);
+		float norm = sqrtf(re * re + im * im);
+		cross[2*k] = (norm > 0) ? re / norm : 0;
+		cross[2*k+1] = (norm > 0) ? im / norm : 0;
+		gcc_weight[k] = norm;
+		total[bin_owner[k]] += norm;
+	}
+
+	//Correlation at each lag, the rotations e^(-jw tau) of consecutive bins are obtained by recurrence
+	for(uint16_t l = 0 ; l <= 2 * GCC_LAG_STEPS ; l++)
+	{
+		float tau = max_lag * ((int16_t)l - GCC_LAG_STEPS) / GCC_LAG_STEPS;
+		float w0 = 2.0f * PI * UNFOLDED_HZ(min_bin) * tau;
+		float dw = 2.0f * PI * (UNFOLDED_HZ(min_bin + 1) - UNFOLDED_HZ(min_bin)) * tau;
+		float c = cosf(w0), s = sinf(w0), dc = cosf(dw), ds = sinf(dw);
+		float sum[AUDIO_MAX_BEACONS] = {0};
+		for(uint16_t k = 0 ; k < band_bins ; k++)
+		{
+			float next_c = c * dc - s * ds;
+			sum[bin_owner[k]] += gcc_weight[k] * (cross[2*k] * c + cross[2*k+1] * s);
+			s = s * dc + c * ds;
+			c = next_c;
+		}
+		for(uint8_t bc = 0 ; bc < nb_beacons ; bc++)
+		{
+			corr[bc][l] = (total[bc] > 0) ? sum[bc] / total[bc] : 0;
+		}
+	}
+
+	for(uint8_t bc = 0 ; bc < nb_beacons ; bc++)
+	{
+		const float* c = corr[bc];
+		uint16_t best = 0;
+		for(uint16_t l = 1 ; l <= 2 * GCC_LAG_STEPS ; l++)
+		{
+			if(c[l] > c[best]){best = l;}
+		}
+
+		//Parabolic refinement, not possible at the ends of the search range
+		float offset = 0;
+		if(best > 0 && best < 2 * GCC_LAG_STEPS)
+		{
+			offset = parabolic_peak_offset(c[best-1], c[best], c[best+1]);
+		}
+		peak[bc] = (offset != 0) ? c[best] - 0.25f * (c[best-1] - c[best+1]) * offset : c[best];
+		lag[bc] = max_lag * ((int16_t)best - GCC_LAG_STEPS + offset) / GCC_LAG_STEPS;
+	}
+}
+
+
+/*
+*	Fills the steering table of the SRP-PHAT with the delays of mic_delays, for each direction of the grid
+*/
+static void srp_init(void)
+{
+	float w0 = 2.0f * PI * UNFOLDED_HZ(min_bin);
+	float dw = 2.0f * PI * (UNFOLDED_HZ(min_bin + 1) - UNFOLDED_HZ(min_bin));
+
+	for(uint16_t d = 0 ; d < SRP_DIRECTIONS ; d++)
+	{
+		float delay_left, delay_front;
+		float* steer = srp_steering[d];
+
+		mic_delays(2.0f * PI * d / SRP_DIRECTIONS, &delay_left, &delay_front);
+
+		steer[0] = cosf(w0 * delay_left);
+		steer[1] = sinf(w0 * delay_left);
+		steer[2] = cosf(dw * delay_left);
+		steer[3] = sinf(dw * delay_left);
+		steer[4] = cosf(w0 * delay_front);
+		steer[5] = sinf(w0 * delay_front);
+		steer[6] = cosf(dw * delay_front);
+		steer[7] = sinf(dw * delay_front);
+	}
+}
+
+
+/*
+*	Steered response power with phase transform of the four microphones over the analyzed band : the spectra are
+*	reduced to their phase, delayed back for each direction of the grid and summed, the power of the sum is the
+*	highest in the direction of the source. Each bin is weighted by the mean magnitude of the microphones, so that
+*	the bins of the beacon dominate the noise-only ones. The power of each beacon only sums its bins, all the
+*	beacons are computed in one pass over the band. The best direction is refined by a parabola.
+*	Writes for each beacon the bearing [deg] in angle and the weighted mean correlation of the six pairs of
+*	microphones in this direction in peak, 1 when all the bins agree
+*/
+static void srp_phat(float* angle, float* peak)
+{
+	float* weight = bin_weight;
+	float total[AUDIO_MAX_BEACONS] = {0};
+
+	//Phase transform, conjugated back if the band was mirrored by the decimation
+	for(uint16_t k = 0 ; k < band_bins ; k++){weight[k] = 0;}
+	for(uint8_t m = 0 ; m < 4 ; m++)
+	{
+		const float* value = band_values[pair_mics[m]];
+		for(uint16_t k = 0 ; k < band_bins ; k++)
+		{
+			float norm = sqrtf(value[2*k] * value[2*k] + value[2*k+1] * value[2*k+1]);
+			phat[m][2*k] = (norm > 0) ? value[2*k] / norm : 0;
+			phat[m][2*k+1] = (norm > 0) ? PHASE_SIGN * value[2*k+1] / norm : 0;
+			weight[k] += norm;
+		}
+	}
+	for(uint16_t k = 0 ; k < band_bins ; k++)
+	{
+		weight[k] *= weight[k];
+		total[bin_owner[k]] += weight[k];
+	}
+
+	for(uint16_t d = 0 ; d < SRP_DIRECTIONS ; d++)
+	{
+		const float* steer = srp_steering[d];
+		float lc = steer[0], ls = steer[1], fc = steer[4], fs = steer[5];
+		float sum[AUDIO_MAX_BEACONS] = {0};
+
+		for(uint16_t k = 0 ; k < band_bins ; k++)
+		{
+			//Left and front rotated by e^(jw delay), right and back by the conjugates
+			float re = phat[0][2*k] * lc - phat[0][2*k+1] * ls + phat[1][2*k] * lc + phat[1][2*k+1] * ls
+						+ phat[2][2*k] * fc - phat[2][2*k+1] * fs + phat[3][2*k] * fc + phat[3][2*k+1] * fs;
+			float im = phat[0][2*k] * ls + phat[0][2*k+1] * lc - phat[1][2*k] * ls + phat[1][2*k+1] * lc
+						+ phat[2][2*k] * fs + phat[2][2*k+1] * fc - phat[3][2*k] * fs + phat[3][2*k+1] * fc;
+			sum[bin_owner[k]] += weight[k] * (re * re + im * im);
+
+			//Rotations of the next bin by recurrence
+			float next_lc = lc * steer[2] - ls * steer[3];
+			ls = ls * steer[2] + lc * steer[3];
+			lc = next_lc;
+			float next_fc = fc * steer[6] - fs * steer[7];
+			fs = fs * steer[6] + fc * steer[7];
+			fc = next_fc;
+		}
+		for(uint8_t bc = 0 ; bc < nb_beacons ; bc++)
+		{
+			srp_power[bc][d] = sum[bc];
+		}
+	}
+
+	for(uint8_t bc = 0 ; bc < nb_beacons ; bc++)
+	{
+		const float* power = srp_power[bc];
+		uint16_t best = 0;
+		for(uint16_t d = 1 ; d < SRP_DIRECTIONS ; d++)
+		{
+			if(power[d] > power[best]){best = d;}
+		}
+
+		//Parabolic refinement with the neighbours on the circle
+		float left = power[(best + SRP_DIRECTIONS - 1) % SRP_DIRECTIONS];
+		float right = power[(best + 1) % SRP_DIRECTIONS];
+		float offset = parabolic_peak_offset(left, power[best], right);
+		float max_power = power[best] - 0.25f * (left - right) * offset;
+
+		//The power of a bin is 4 plus twice the sum of the correlations of the six pairs
+		peak[bc] = (total[bc] > 0) ? (max_power / total[bc] - 4.0f) / 12.0f : 0;
+		angle[bc] = 360.0f * (best + offset) / SRP_DIRECTIONS;
+		if(angle[bc] > 180.0f){angle[bc] -= 360.0f;}
+	}
+}
+
+
+/*
+*	Phase differences between the left-right and front-back microphones at the peak bin freq, common to all microphones.
+*	The peak is interpolated with a parabola over the magnitudes of the four microphones, then the phases of the peak
+*	bin and of its neighbour on the side of the interpolated peak are computed together (eight atan2) and the
+*	differences of the two bins are averaged, weighted by their magnitudes.
+*	Returns the interpolated position of the peak [bins]
+*/
+static float extract_phase_diffs(uint16_t freq, float* diff_lr, float* diff_fb)
+{
+	float mag[3] = {0, 0, 0};
+	float y[8], x[8], phase[8];
+	float offset = 0;
+
+	//Summed magnitudes around the peak, the neighbours must be in the analyzed band
+	for(uint8_t m = 0 ; m < 4 ; m++)
+	{
+		for(int8_t d = -1 ; d <= 1 ; d++)
+		{
+			if(freq + d < min_bin || freq + d > max_bin){continue;}
+			const float* value = &band_values[pair_mics[m]][2 * (freq + d - min_bin)];
+			mag[d+1] += sqrtf(value[0] * value[0] + value[1] * value[1]);
+		}
+	}
+	if(freq > min_bin && freq < max_bin){offset = parabolic_peak_offset(mag[0], mag[1], mag[2]);}
+
+	//Peak bin and neighbour on the side of the interpolated peak, without neighbour if the peak is exactly on the bin
+	uint16_t bins[2] = {freq, (offset < 0) ? freq - 1 : freq + 1};
+	float weight[2] = {mag[1], (offset == 0) ? 0 : ((offset < 0) ? mag[0] : mag[2])};
+
+	for(uint8_t b = 0 ; b < 2 ; b++)
+	{
+		for(uint8_t m = 0 ; m < 4 ; m++)
+		{
+			const float* value = &band_values[pair_mics[m]][2 * (bins[b] - min_bin)];
+			x[4*b + m] = value[0];
+			y[4*b + m] = value[1];
+		}
+	}
+	atan2_approx(y, x, phase, 8);
+
+	//Weighted differences, conjugated back if the band was mirrored by the decimation
+	float lr = weight[0] * wrap_phase(phase[0] - phase[1]) + weight[1] * wrap_phase(phase[4] - phase[5]);
+	float fb = weight[0] * wrap_phase(phase[2] - phase[3]) + weight[1] * wrap_phase(phase[6] - phase[7]);
+	*diff_lr = PHASE_SIGN * lr / (weight[0] + weight[1]);
+	*diff_fb = PHASE_SIGN * fb / (weight[0] + weight[1]);
+
+	return freq + offset;
+}
+
+
+//Wraps an angle difference to [-180, 180]
+static float wrap_degrees(float x)
+{
+	if(x > 180.0f){return x - 360.0f;}
+	if(x < -180.0f){return x + 360.0f;}
+	return x;
+}
+
+
+//Returns the heading [deg] of the robot in [-180, 180], positive clockwise, from the difference between the step counters
+static float robot_heading(void)
+{
+	return remainderf((float)(left_motor_get_pos() - right_motor_get_pos()) * DEG_PER_STEP, 360.0f);
+}
+
+
+//Variance of the tracked angle of beacon bc predicted when now samples have been written in the ring, grown with the audio time elapsed since its last update
+static float predicted_variance(const beacon_t* bc, uint32_t now)
+{
+	int32_t elapsed = (int32_t)(now - bc->track_time);
+	float variance = bc->track_variance + TRACK_PROCESS_NOISE * (elapsed > 0 ? elapsed : 0) / FRAME_FREQ;
+	return (variance < TRACK_RESET_VARIANCE) ? variance : TRACK_RESET_VARIANCE;
+}
+
+
+//Restarts the bearing tracker of beacon bc straight ahead of the robot, the frames holding samples written before the reset are not accepted
+static void reset_tracker(beacon_t* bc)
+{
+	bc->track_angle = robot_heading();
+	bc->track_variance = TRACK_RESET_VARIANCE;
+	bc->track_time = written;
+	bc->track_first = written;
+	bc->track_rejects = 0;
+}
+
+
+/*
+*	Update of the bearing tracker of beacon bc with the bearing of the current frame, whose noise decreases with its
+*	confidence. The prediction only grows the variance with the audio time elapsed since the last update, the state
+*	does not depend on the frame length
+*/
+static void track_bearing(beacon_t* bc, float measured, float frame_confidence)
+{
+	uint32_t now = frame_end;
+	float variance = predicted_variance(bc, now);
+	float noise = TRACK_MEAS_STD / frame_confidence;
+	float innovation = wrap_degrees(measured - bc->track_angle);
+
+	//The frame still holds samples recorded before the last reset
+	if((int32_t)(now - fft_size - bc->track_first) < 0){return;}
+
+	//Outlier, unless the source really moved and all the recent frames disagree with the track
+	if(innovation * innovation > TRACK_GATE * TRACK_GATE * (variance + noise * noise))
+	{
+		if(++bc->track_rejects < TRACK_MAX_REJECTS){return;}
+		variance = TRACK_RESET_VARIANCE;
+	}
+	bc->track_rejects = 0;
+
+	float gain = variance / (variance + noise * noise);
+	chSysLock();
+	//reset_audio was called during the update
+	if((int32_t)(now - fft_size - bc->track_first) < 0)
+	{
+		chSysUnlock();
+		return;
+	}
+	bc->track_angle = wrap_degrees(bc->track_angle + gain * innovation);
+	bc->track_variance = (1.0f - gain) * variance;
+	bc->track_time = now;
+	chSysUnlock();
+}
+
+
+//Places the tracked beacons in the bins of the current frame length and assigns each bin of the analyzed band to the nearest beacon
+static void assign_bins(void)
+{
+	for(uint8_t b = 0 ; b < nb_beacons ; b++)
+	{
+		beacons[b].bin = HZ_TO_BIN(ALIAS_HZ(beacons[b].hz), fft_size);
+	}
+	for(uint16_t k = 0 ; k < band_bins ; k++)
+	{
+		uint8_t nearest = 0;
+		for(uint8_t b = 1 ; b < nb_beacons ; b++)
+		{
+			if(abs(min_bin + k - beacons[b].bin) < abs(min_bin + k - beacons[nearest].bin)){nearest = b;}
+		}
+		bin_owner[k] = nearest;
+	}
+}
+
+
+/*
+*	Replaces the tracked beacons by the nb frequencies of hz and assigns each bin of the analyzed band
+*	to the nearest beacon. Called by the DSP thread between two frames
+*/
+static void apply_beacons(const uint16_t* hz, uint8_t nb)
+{
+	chSysLock();
+	for(uint8_t b = 0 ; b < nb ; b++)
+	{
+		beacon_t* bc = &beacons[b];
+		bc->hz = hz[b];
+		bc->status = NO_AUDIO;
+		bc->confidence = 0;
+		bc->peak_hz = hz[b];
+		reset_tracker(bc);
+		//The samples of the frames in progress are as valid for the new beacons
+		bc->track_first = written - RING_SIZE;
+	}
+	nb_beacons = nb;
+	//A shorter list falls back to its first beacon rather than reporting a slot that is not tracked anymore
+	if(active_beacon >= nb){active_beacon = 0;}
+	chSysUnlock();
+	assign_bins();
+
+	//Shortest frame length whose bins still separate the beacons as set_audio_beacons requires
+	shortest_size = MIN_FFT_SIZE;
+	for(uint8_t b = 0 ; b < nb ; b++)
+	{
+		for(uint8_t other = 0 ; other < b ; other++)
+		{
+			while(shortest_size < FFT_SIZE && abs(HZ_TO_BIN(ALIAS_HZ(hz[b]), shortest_size)
+					- HZ_TO_BIN(ALIAS_HZ(hz[other]), shortest_size)) <= 2 * MAX_ERROR(shortest_size))
+			{
+				shortest_size *= 2;
+			}
+		}
+	}
+}
+
+
+/*
+*	Sets the geometry of the frames of size samples for the detection mode : analyzed band, beacon bins, SRP-PHAT steering
+*	table and spectrum of the code of the coded beacons. The running noise floor of the CFAR detector and the running SNR
+*	restart, the bins changed
+*/
+static void set_frame_geometry(uint16_t size, uint8_t mode)
+{
+	uint16_t center = HZ_TO_BIN(ALIAS_HZ(SOURCE_HZ), size);
+
+	fft_size = size;
+	frame_detection = mode;
+#ifdef AUDIO_Q15
+	cfft_instance = get_cfft_q15_instance(size);
+#else
+	if(arm_rfft_fast_init_f32(&rfft_instance, size) != ARM_MATH_SUCCESS){chSysHalt("RFFT size not supported");}
+#endif
+	bin_hz = (float)FRAME_FREQ / size;
+	max_error = MAX_ERROR(size);
+	cfar_min_noise = CFAR_MIN_NOISE(size);
+
+	//The band of the short frames is widened to keep the cells of the CFAR detector, within the spectrum
+	min_bin = MIN_FREQ(size);
+	max_bin = MAX_FREQ(size);
+	if(min_bin + BAND_MIN_HALF_BINS > center){min_bin = (center > BAND_MIN_HALF_BINS) ? center - BAND_MIN_HALF_BINS : 1;}
+	if(max_bin < center + BAND_MIN_HALF_BINS){max_bin = center + BAND_MIN_HALF_BINS;}
+	//The coded beacons fill their own band, their frames have one length only
+	if(mode != DETECTION_TONE && size == CODE_SIZE)
+	{
+		min_bin = CODE_MIN_FREQ;
+		max_bin = CODE_MAX_FREQ;
+	}
+	if(max_bin > size / 2 - 1){max_bin = size / 2 - 1;}
+	band_bins = max_bin - min_bin + 1;
+
+	assign_bins();
+	srp_init();
+	calibration_table();
+	memset(floor_frames, 0, sizeof(floor_frames));
+	snr_frames = 0;
+#if AUDIO_CODED_BEACONS
+	if(mode != DETECTION_TONE && size == CODE_SIZE){code_init();}
+	code_frames = 0;
+#endif
+}
+
+
+/*
+*	Chooses the length of the next frames from the running SNR of the selected beacon : shorter when it would still
+*	be above AUDIO_SNR_SHORTEN_DB, longer when it is below AUDIO_SNR_LENGTHEN_DB. The frames are never shorter than
+*	the ones separating the beacons. The frames of the coded beacons hold one period of the code.
+*	Called by the DSP thread after each frame
+*/
+static uint16_t adapt_frame_size(void)
+{
+	uint16_t size = fft_size;
+
+	if(detection != DETECTION_TONE){return CODE_SIZE;}
+	if(forced_size){return forced_size;}
+	if(size < shortest_size){return shortest_size;}
+
+	//Plain mean until SNR_FRAMES frames have been averaged at this length, then running mean
+	if(snr_frames < SNR_FRAMES){snr_frames++;}
+	running_snr_db += (beacons[active_beacon].snr_db - running_snr_db) / snr_frames;
+	if(snr_frames < SNR_FRAMES){return size;}
+
+	if(running_snr_db - SNR_HALVING_DB >= AUDIO_SNR_SHORTEN_DB && size / 2 >= shortest_size){size /= 2;}
+	else if(running_snr_db < AUDIO_SNR_LENGTHEN_DB && size < MAX_FFT_SIZE){size *= 2;}
+	return size;
+}
+
+
+/*
+*	Spectral processing of the frame of size samples starting at index start of the ring : detection of the beacons and
+*	update of their bearings. heading is the heading of the robot at the middle of the frame, it brings the bearings in
+*	the ground frame
+*/
+static void process_frame(uint16_t start, uint16_t size, float heading)
+{
+	//Phase differences computed from the audio data between respectively left-right and front-back microphones
+	float phase_diff_lr=0, phase_diff_fb=0;
+	//Peak of each beacon in the spectra of the microphones and its SNR
+	uint16_t freq[AUDIO_MAX_BEACONS];
+	float snr[AUDIO_MAX_BEACONS];
+	//Bearing and confidence of each beacon in this frame alone
+	float frame_angle[AUDIO_MAX_BEACONS], frame_confidence[AUDIO_MAX_BEACONS];
+	bool detected = FALSE;
+
+	//New beacons requested by set_audio_beacons
+	if(nb_pending)
+	{
+		chSysLock();
+		uint16_t hz[AUDIO_MAX_BEACONS];
+		uint8_t nb = nb_pending;
+		memcpy(hz, pending_hz, sizeof(hz));
+		nb_pending = 0;
+		chSysUnlock();
+		apply_beacons(hz, nb);
+	}
+	//The length of the frames or the detection mode changed
+	uint8_t mode = detection;
+	if(size != fft_size || mode != frame_detection){set_frame_geometry(size, mode);}
+	//New calibration saved by save_audio_calibration
+	if(calib_pending)
+	{
+		chSysLock();
+		calibration = pending_calibration;
+		calib_pending = FALSE;
+		chSysUnlock();
+		calibrated = TRUE;
+		calibration_table();
+	}
+	//The frames handed over before the coded detection was selected do not hold one period of the code
+	if(frame_detection != DETECTION_TONE && size != CODE_SIZE)
+	{
+		for(uint8_t b = 0 ; b < nb_beacons ; b++)
+		{
+			beacons[b].status = NO_AUDIO;
+			beacons[b].confidence = 0;
+		}
+		return;
+	}
+	//The offsets are not corrected while they are measured, they are measured on tones
+	bool measure = calibrating && frame_detection == DETECTION_TONE;
+	bool correct = calibrated && !calibrating;
+
+	//Spectrum of each microphone, without the tones of the motors
+	motor_notch(frame_rates, frame_nb_rates);
+	memset(band_power, 0, sizeof(band_power));
+	extract_mic(start, MIC_LEFT, mic_input);
+	analyze_mic(mic_input);
+	apply_notch();
+	keep_band(MIC_LEFT, correct);
+	extract_mic(start, MIC_RIGHT, mic_input);
+	analyze_mic(mic_input);
+	apply_notch();
+	keep_band(MIC_RIGHT, correct);
+	extract_mic(start, MIC_FRONT, mic_input);
+	analyze_mic(mic_input);
+	apply_notch();
+	keep_band(MIC_FRONT, correct);
+	extract_mic(start, MIC_BACK, mic_input);
+	analyze_mic(mic_input);
+	apply_notch();
+	keep_band(MIC_BACK, correct);
+
+	//Detection of each beacon on the four microphones together, or of the coded beacon whose code fills the band
+	if(frame_detection == DETECTION_TONE)
+	{
+		max_frequency(freq, snr);
+	}
+#if AUDIO_CODED_BEACONS
+	else
+	{
+		memset(bin_owner, active_beacon, band_bins);
+		match_code(freq, snr, &phase_diff_lr, &phase_diff_fb);
+	}
+#endif
+	for(uint8_t b = 0 ; b < nb_beacons ; b++)
+	{
+		beacon_t* bc = &beacons[b];
+		bc->snr_db = (snr[b] > 0) ? 10.0f * log10f(snr[b]) : -100.0f;
+		if((freq[b] != (uint16_t)-1) && (abs(freq[b] - bc->bin) <= max_error))
+		{
+			bc->status = AUDIO_DETECTED;
+			detected = TRUE;
+		}
+		//If the peak is noise or too far from the beacon
+		else
+		{
+			bc->status = NO_AUDIO;
+			bc->confidence = 0;
+		}
+	}
+	if(!detected){return;}
+
+	//Bearings of this frame alone, for all the beacons at once
+	if(bearing == BEARING_SRP_PHAT)
+	{
+		//From the four microphones jointly, the confidence is the mean correlation of the pairs
+		srp_phat(frame_angle, frame_confidence);
+	}
+	else
+	{
+		//From the delays between the opposite microphones, with the same orientation as the phase
+		//differences. The confidence is the worst of the two correlations
+		float delay_lr[AUDIO_MAX_BEACONS], delay_fb[AUDIO_MAX_BEACONS];
+		float peak_lr[AUDIO_MAX_BEACONS], peak_fb[AUDIO_MAX_BEACONS];
+		gcc_phat(band_values[MIC_LEFT], band_values[MIC_RIGHT], GCC_MAX_LAG_LR, delay_lr, peak_lr);
+		gcc_phat(band_values[MIC_FRONT], band_values[MIC_BACK], GCC_MAX_LAG_FB, delay_fb, peak_fb);
+		for(uint8_t b = 0 ; b < nb_beacons ; b++)
+		{
+			frame_angle[b] = atan2f(delay_lr[b] / MIC_LR_DISTANCE, -delay_fb[b] / MIC_FB_DISTANCE) * 360.0f / (2.0f * PI);
+			frame_confidence[b] = (peak_lr[b] < peak_fb[b]) ? peak_lr[b] : peak_fb[b];
+		}
+	}
+
+	for(uint8_t b = 0 ; b < nb_beacons ; b++)
+	{
+		beacon_t* bc = &beacons[b];
+		if(bc->status == NO_AUDIO){continue;}
+
+		bc->frame_angle = frame_angle[b];
+		bc->confidence = (frame_confidence[b] > 0) ? frame_confidence[b] : 0;
+
+		//Phase differences of the opposite mics at the interpolated peak, the ones of the coded beacon were read at its arrival
+		if(frame_detection == DETECTION_TONE)
+		{
+			bc->peak_hz = UNFOLDED_HZ(extract_phase_diffs(freq[b], &phase_diff_lr, &phase_diff_fb));
+			if(measure){accumulate_calibration(freq[b], bc->peak_hz);}
+		}
+#if AUDIO_CODED_BEACONS
+		else
+		{
+			bc->peak_hz = SOURCE_HZ + code_offset_hz;
+		}
+#endif
+
+		//Bearing of the phase differences, scaled by the spacing of each pair. The front-back difference is inverted to correct for the orientation.
+		//Phase differences larger than the ones of the largest physical delays are noise
+		float max_lr = 2.0f * PI * bc->peak_hz * GCC_MAX_LAG_LR;
+		float max_fb = 2.0f * PI * bc->peak_hz * GCC_MAX_LAG_FB;
+		bool phase_valid = (fabsf(phase_diff_lr) <= max_lr) && (fabsf(phase_diff_fb) <= max_fb);
+		float phase_angle = atan2f(phase_diff_lr / MIC_LR_DISTANCE, -phase_diff_fb / MIC_FB_DISTANCE) * 360.0f / (2.0f * PI);
+
+		//The selected estimator feeds the tracker, in the ground frame
+		if(bc->confidence >= TRACK_MIN_CONFIDENCE && (bearing != BEARING_PHASE || phase_valid))
+		{
+			float measured = (bearing != BEARING_PHASE) ? bc->frame_angle : phase_angle;
+			track_bearing(bc, wrap_degrees(measured + heading), bc->confidence);
+		}
+	}
+}
+
+
+/*
+*	Publishes the current results of every beacon in the snapshot buffer not used by the readers.
+*	To be called in a critical section, which serializes the writers
+*/
+static void publish_snapshotS(void)
+{
+	audio_snapshot_t* snap = snapshots[(snapshot_seq + 1) & 1];
+	float heading = robot_heading();
+
+	for(uint8_t b = 0 ; b < AUDIO_MAX_BEACONS ; b++)
+	{
+		const beacon_t* bc = &beacons[b];
+		bool tracked = (b < nb_beacons);
+
+		snap[b].frame = frame_count;
+		snap[b].time = chVTGetSystemTimeX();
+		snap[b].status = tracked ? bc->status : NO_AUDIO;
+		snap[b].heading = heading;
+		snap[b].angle = wrap_degrees(bc->track_angle - heading);
+		snap[b].variance = tracked ? predicted_variance(bc, written) : TRACK_RESET_VARIANCE;
+		snap[b].age_ms = (uint32_t)((uint64_t)(written - bc->track_time) * 1000 / FRAME_FREQ);
+		snap[b].frame_length = fft_size;
+		snap[b].confidence = bc->confidence;
+		snap[b].snr_db = bc->snr_db;
+		snap[b].peak_hz = bc->peak_hz;
+		snap[b].motor_noise = tracked && bc->motor_noise;
+	}
+
+	//The buffer is written before it is published
+	__atomic_store_n(&snapshot_seq, snapshot_seq + 1, __ATOMIC_RELEASE);
+}
+
+
+//DSP thread in charge of the spectral processing of the frames written in the ring by processAudioData.
+//The buffers of the band are static, the deepest path measured with -fstack-usage is about 700 bytes (the thread
+//with process_frame inlined 432, doGoertzel 208, then cosf and sinf), before the FPU exception frame (104) and the
+//context of the port : twice that for the libm callees and the interrupts
+static THD_WORKING_AREA(waAudioDSP, 2048);
+static THD_FUNCTION(AudioDSP, arg)
+{
+	chRegSetThreadName(__FUNCTION__);
+	(void)arg;
+
+	rtcnt_t start, elapsed;
+	uint16_t size;
+
+	while(1)
+	{
+		//Waits until a frame is ready
+		chBSemWait(&frame_ready_sem);
+
+		start = chSysGetRealtimeCounterX();
+		process_frame(frame_start, frame_length, frame_heading);
+		size = adapt_frame_size();
+		elapsed = chSysGetRealtimeCounterX() - start;
+
+		chSysLock();
+		frame_count++;
+		stats.processed++;
+		stats.last_frame_rtc = elapsed;
+		if(elapsed > stats.max_frame_rtc){stats.max_frame_rtc = elapsed;}
+		//The callback went so far ahead that it rewrote the start of the frame during the processing
+		//RING_SIZE is larger than every frame length, the margin is positive
+		if(written - frame_end > (uint32_t)(RING_SIZE - fft_size)){stats.overwritten++;}
+		//A new frame can be handed over, with the length chosen for it
+		next_size = size;
+		dsp_busy = FALSE;
+		publish_snapshotS();
+		//The thread waiting in wait_audio_frame may have a higher priority
+		chBSemSignalI(&frame_done_sem);
+		chSchRescheduleS();
+		chSysUnlock();
+	}
+}
+
+
+#if AUDIO_DECIMATION > 1
+static float sinc(float x)
+{
+	return (x == 0) ? 1.0f : sinf(PI * x) / (PI * x);
+}
+
+
+/*
+*	Designs the band-pass filter of the front-end (windowed sinc, Hamming window), normalized
+*	to a unit gain at SOURCE_HZ, and initializes the decimator of each microphone
+*/
+static void decimator_init(void)
+{
+	float low = (float)DECIM_LOW_HZ / SAMPLE_FREQ;
+	float high = (float)DECIM_HIGH_HZ / SAMPLE_FREQ;
+	float w0 = 2.0f * PI * SOURCE_HZ / SAMPLE_FREQ;
+	float gain_re = 0, gain_im = 0, gain;
+
+	for(uint16_t n = 0 ; n < DECIM_TAPS ; n++)
+	{
+		float t = n - (DECIM_TAPS - 1) / 2.0f;
+		float window = 0.54f - 0.46f * cosf(2.0f * PI * n / (DECIM_TAPS - 1));
+		decim_coeffs[n] = window * (2.0f * high * sinc(2.0f * high * t) - 2.0f * low * sinc(2.0f * low * t));
+		gain_re += decim_coeffs[n] * cosf(w0 * n);
+		gain_im += decim_coeffs[n] * sinf(w0 * n);
+	}
+	gain = sqrtf(gain_re * gain_re + gain_im * gain_im);
+	for(uint16_t n = 0 ; n < DECIM_TAPS ; n++)
+	{
+		decim_coeffs[n] /= gain;
+	}
+
+	for(uint8_t mic = 0 ; mic < 4 ; mic++)
+	{
+		arm_fir_decimate_init_f32(&decimators[mic], DECIM_TAPS, AUDIO_DECIMATION, decim_coeffs, decim_state[mic], CHUNK_SAMPLES);
+	}
+}
+
+
+/*
+*	Band-pass filters and decimates a chunk of interleaved samples of the four microphones into decimated,
+*	with the same interleaved layout. num_samples is always 4 * CHUNK_SAMPLES.
+*	Returns the number of samples written
+*/
+static uint16_t decimate_chunk(int16_t *data, uint16_t num_samples)
+{
+	uint16_t nb_in = num_samples / 4;
+	uint16_t nb_out = nb_in / AUDIO_DECIMATION;
+
+	for(uint8_t mic = 0 ; mic < 4 ; mic++)
+	{
+		for(uint16_t i = 0 ; i < nb_in ; i++)
+		{
+			decim_input[i] = (float)data[4*i + mic];
+		}
+		arm_fir_decimate_f32(&decimators[mic], decim_input, decim_output, nb_in);
+		//Back to int16 with saturation, the ring and the Q15 pipeline work on int16 samples
+		for(uint16_t i = 0 ; i < nb_out ; i++)
+		{
+			float y = decim_output[i];
+			if(y > INT16_MAX){y = INT16_MAX;}
+			if(y < INT16_MIN){y = INT16_MIN;}
+			decimated[4*i + mic] = (int16_t)lrintf(y);
+		}
+	}
+	return 4 * nb_out;
+}
+#endif
+
 
-#define MIN_VALUE_THRESHOLD	10000 			//Threshold value for the max_frequency function
-#define MIN_FREQ			59				//We don't analyze before this index to not use resources for nothing
-#define FREQ_SOURCE			64				//64 * 15.3 = 980hz, in reality best results were observed at 990hz
-#define MAX_FREQ			69				//We don't analyze after this index to not use resources for nothing
-#define MAX_ERROR			1				//Frequency tolerance
+/*
+*	Returns the hop between the frames of size samples : the overlap does not change with the length, but the shortened
+*	frames do not come more often than the callbacks, the DSP thread would skip every other one
+*/
+static uint16_t hop_size(uint16_t size)
+{
+	uint32_t hop = (uint32_t)AUDIO_HOP_SIZE * size / FFT_SIZE;
 
-#define A					0.925f			//Coefficient for the low-pass filter to apply to the past values
-#define B					0.075f			//= 1-A, coefficient for the new value
-#define BASE_LR_VALUE		0				//Value of the phase difference between left and right microphones when the source is in front
-#define BASE_FB_VALUE		-0.5f			//Value of the phase difference between front and back microphones when the source is in front
+	if(size < FFT_SIZE && hop < FRAME_CHUNK){hop = (AUDIO_HOP_SIZE < FRAME_CHUNK) ? AUDIO_HOP_SIZE : FRAME_CHUNK;}
+	return hop ? hop : 1;
+}
 
 
-//2 times FFT_SIZE because these arrays contain complex numbers (real + imaginary)
-static float micLeft_cmplx_input[2 * FFT_SIZE];
-static float micRight_cmplx_input[2 * FFT_SIZE];
-static float micFront_cmplx_input[2 * FFT_SIZE];
-static float micBack_cmplx_input[2 * FFT_SIZE];
-//Arrays containing the computed magnitude of the complex numbers
-static float micLeft_output[FFT_SIZE];
-static float micRight_output[FFT_SIZE];
-static float micFront_output[FFT_SIZE];
-static float micBack_output[FFT_SIZE];
+/*
+*	Returns the heading of the robot at the middle of a frame of size samples ending remaining samples before the end of
+*	the chunk whose heading is heading_history[pos], interpolated between the headings read at the callbacks
+*/
+static float middle_heading(uint8_t pos, uint16_t size, uint16_t remaining)
+{
+	float chunks = (float)(size / 2 + remaining) / FRAME_CHUNK;
+	uint8_t back = (uint8_t)chunks;
+	float after = heading_history[(pos + CHUNK_HISTORY - back) % CHUNK_HISTORY];
+	float before = heading_history[(pos + 2 * CHUNK_HISTORY - back - 1) % CHUNK_HISTORY];
 
-//Moving averages for the phase differences
-static float mov_avg_lr = 0;
-static float mov_avg_fb = 0;
-//Audio status variable
-static uint8_t audio_status = NO_AUDIO;
+	return wrap_degrees(after + (chunks - back) * wrap_degrees(before - after));
+}
 
 
-//Simple function used to detect the highest value in the buffer
-uint16_t max_frequency(float* data)
+/*
+*	Writes in rates the distinct step rates of the motors during a frame of size samples ending remaining samples before
+*	the end of the chunk whose speeds are speed_history[pos], up to MOTOR_MAX_RATES. Returns their number
+*/
+static uint8_t frame_motor_rates(uint8_t pos, uint16_t size, uint16_t remaining, uint16_t* rates)
 {
-	float max_norm = MIN_VALUE_THRESHOLD;
-	int16_t max_norm_index = -1; 
+	uint8_t nb = 0;
+	uint8_t chunks = (size + remaining + FRAME_CHUNK - 1) / FRAME_CHUNK;
 
-	//search for the highest peak
-	for(uint16_t i = MIN_FREQ ; i <= MAX_FREQ ; i++){
-		if(data[i] > max_norm){
-			max_norm = data[i];
-			max_norm_index = i;
+	//The chunk before the first one holds the speed at the start of the frame
+	for(uint8_t back = 0 ; back <= chunks ; back++)
+	{
+		for(uint8_t wheel = 0 ; wheel < 2 ; wheel++)
+		{
+			uint16_t rate = abs(speed_history[(pos + CHUNK_HISTORY - back) % CHUNK_HISTORY][wheel]);
+			uint8_t i = 0;
+			while(i < nb && rates[i] != rate){i++;}
+			if(i == nb && nb < MOTOR_MAX_RATES && rate){rates[nb++] = rate;}
 		}
 	}
-	return max_norm_index;
+	return nb;
 }
 
 
 /*
 *	Callback called when the demodulation of the four microphones is done.
 *	We get 160 samples per mic every 10ms (16kHz)
+*	With AUDIO_DECIMATION > 1 the samples are first band-pass filtered and decimated.
+*	Then only copies the samples into the ring buffer, every sample is kept. Each time a hop of new samples
+*	has been written, the last samples are handed to the DSP thread as a new frame of the length it chose.
 *	
 *	params :
 *	int16_t *data			Buffer containing 4 times 160 samples. the samples are sorted by micro
@@ -80,115 +1844,503 @@ uint16_t max_frequency(float* data)
 */
 void processAudioData(int16_t *data, uint16_t num_samples)
 {
-	//Number of samples in the buffer that we have to fill to FFT_SIZE
-	static uint16_t nb_samples = 0;
-	//Phase differences computed from the audio data between respectively left-right and front-back microphones
-	float phase_diff_lr=0, phase_diff_fb=0;
-	//Loop to fill the buffers
-	for(uint16_t i = 0 ; i < num_samples ; i+=4)
-	{
-		//construct an array of complex numbers. Put 0 to the imaginary part
-		micRight_cmplx_input[nb_samples] = (float)data[i + MIC_RIGHT];
-		micLeft_cmplx_input[nb_samples] = (float)data[i + MIC_LEFT];
-		micBack_cmplx_input[nb_samples] = (float)data[i + MIC_BACK];
-		micFront_cmplx_input[nb_samples] = (float)data[i + MIC_FRONT];
+	//Write position in the ring, number of samples available for a frame and new samples since the last frame
+	static uint16_t write_pos = 0;
+	static uint16_t nb_filled = 0;
+	static uint16_t nb_new = 0;
+	//Index of the heading and speeds read at this callback in heading_history and speed_history
+	static uint8_t heading_pos = 0;
+
+	//The samples of this chunk end now
+	heading_pos = (heading_pos + 1) % CHUNK_HISTORY;
+	heading_history[heading_pos] = robot_heading();
+	speed_history[heading_pos][0] = motor_speed[0];
+	speed_history[heading_pos][1] = motor_speed[1];
 
-		nb_samples++;
+#if AUDIO_DECIMATION > 1
+	num_samples = decimate_chunk(data, num_samples);
+	data = decimated;
+#endif
+	uint16_t remaining = num_samples / 4;
 
-		micRight_cmplx_input[nb_samples] = 0;
-		micLeft_cmplx_input[nb_samples] = 0;
-		micBack_cmplx_input[nb_samples] = 0;
-		micFront_cmplx_input[nb_samples] = 0;
+	while(remaining)
+	{
+		//Length of the next frame and its hop, after a change the frame may already be due
+		uint16_t size = next_size;
+		uint16_t hop = hop_size(size);
+		//Copies up to the end of the ring or up to the next frame, whichever comes first
+		uint16_t nb_copy = remaining;
+		int32_t to_frame = (size - nb_filled > hop - nb_new) ? size - nb_filled : hop - nb_new;
+		if(to_frame < 1){to_frame = 1;}
+		if(nb_copy > RING_SIZE - write_pos){nb_copy = RING_SIZE - write_pos;}
+		if(nb_copy > to_frame){nb_copy = to_frame;}
+
+		memcpy(&ring[4 * write_pos], data, 4 * nb_copy * sizeof(int16_t));
+		data += 4 * nb_copy;
+		remaining -= nb_copy;
+		write_pos += nb_copy;
+		if(write_pos >= RING_SIZE){write_pos = 0;}
+		nb_new += nb_copy;
+		nb_filled = (nb_filled + nb_copy > MAX_FFT_SIZE) ? MAX_FFT_SIZE : nb_filled + nb_copy;
 
-		nb_samples++;
+		if(nb_filled < size || nb_new < hop)
+		{
+			chSysLock();
+			written += nb_copy;
+			chSysUnlock();
+			continue;
+		}
+		nb_new = 0;
 
-		//stop when buffer is full
-		if(nb_samples >= (2 * FFT_SIZE))
+		chSysLock();
+		written += nb_copy;
+		stats.frames++;
+		if(!dsp_busy)
 		{
-			break;
+			//Hands the last size samples to the DSP thread
+			dsp_busy = TRUE;
+			frame_start = (write_pos >= size) ? write_pos - size : write_pos + RING_SIZE - size;
+			frame_length = size;
+			frame_end = written;
+			frame_heading = middle_heading(heading_pos, size, remaining);
+			frame_nb_rates = frame_motor_rates(heading_pos, size, remaining, frame_rates);
+			//The DSP thread may have a higher priority than the one of the callback
+			chBSemSignalI(&frame_ready_sem);
+			chSchRescheduleS();
 		}
+		else
+		{
+			//The DSP thread is still working on the previous frame, this one is skipped
+			stats.overruns++;
+		}
+		chSysUnlock();
 	}
+}
 
-	if(nb_samples >= (2 * FFT_SIZE))
+
+//Starts the DSP thread, to be called before mic_start
+void audio_processing_start(void)
+{
+	//The robot did not move before the first callback
+	for(uint8_t i = 0 ; i < CHUNK_HISTORY ; i++)
 	{
+		heading_history[i] = robot_heading();
+		speed_history[i][0] = speed_history[i][1] = 0;
+	}
+#if AUDIO_DECIMATION > 1
+	decimator_init();
+#endif
+	//Offsets of the microphones measured by save_audio_calibration
+	calibrated = read_calibration(&calibration);
+	set_frame_geometry(FFT_SIZE, detection);
+	set_audio_false_alarm(AUDIO_CFAR_PFA);
 
-		//FFT processing
-		doFFT_optimized(FFT_SIZE, micRight_cmplx_input);
-		doFFT_optimized(FFT_SIZE, micLeft_cmplx_input);
-		doFFT_optimized(FFT_SIZE, micFront_cmplx_input);
-		doFFT_optimized(FFT_SIZE, micBack_cmplx_input);
+	//Beacon at SOURCE_HZ until set_audio_beacons is called
+	uint16_t hz = SOURCE_HZ;
+	apply_beacons(&hz, 1);
+	chSysLock();
+	publish_snapshotS();
+	chSysUnlock();
 
-		//Magnitude processing
-		arm_cmplx_mag_f32(micRight_cmplx_input, micRight_output, FFT_SIZE);
-		arm_cmplx_mag_f32(micLeft_cmplx_input, micLeft_output, FFT_SIZE);
-		arm_cmplx_mag_f32(micFront_cmplx_input, micFront_output, FFT_SIZE);
-		arm_cmplx_mag_f32(micBack_cmplx_input, micBack_output, FFT_SIZE);
-		nb_samples = 0;
+	chThdCreateStatic(waAudioDSP, sizeof(waAudioDSP), NORMALPRIO+1, AudioDSP, NULL);
+}
 
-		//Finds the frequency of each microphone
-		uint16_t freq_left = max_frequency(micLeft_output);
-		uint16_t freq_right = max_frequency(micRight_output);
-		uint16_t freq_front = max_frequency(micFront_output);
-		uint16_t freq_back = max_frequency(micBack_output);
 
-		//Detection of the wanted frequency and check if all microphones have the same max frequency
-		if((abs(freq_left - FREQ_SOURCE)<= MAX_ERROR) && (freq_right == freq_left)&&
-				(freq_front == freq_left)&&	(freq_back == freq_left))
-		{
+//Forgets the tracked bearings of all the beacons, the next frames restart the trackers
+void reset_audio (void)
+{
+	chSysLock();
+	for(uint8_t b = 0 ; b < AUDIO_MAX_BEACONS ; b++)
+	{
+		reset_tracker(&beacons[b]);
+	}
+	//The snapshot shows the reset without waiting for the next frame
+	publish_snapshotS();
+	chSysUnlock();
+}
 
 
-			//Update the audio status
-			audio_status = AUDIO_DETECTED;
+//Copies the results of beacon for the last processed frame, without lock
+void get_beacon_snapshot(uint8_t beacon, audio_snapshot_t* dest)
+{
+	uint32_t seq;
 
-			//Computing the phases from the data of two opposite mics and subtracting to obtain the phase difference
-			phase_diff_lr = atan2f(micLeft_cmplx_input[freq_left+1],micLeft_cmplx_input[freq_left])
-												-atan2f(micRight_cmplx_input[freq_right+1],micRight_cmplx_input[freq_right]);
-			phase_diff_fb = atan2f(micFront_cmplx_input[freq_front+1],micFront_cmplx_input[freq_front])
-												-atan2f(micBack_cmplx_input[freq_back+1],micBack_cmplx_input[freq_back]);
+	do
+	{
+		seq = __atomic_load_n(&snapshot_seq, __ATOMIC_ACQUIRE);
+		*dest = snapshots[seq & 1][beacon];
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	}
+	//A publication happened during the copy, the next one may have been writing the copied buffer
+	while(__atomic_load_n(&snapshot_seq, __ATOMIC_RELAXED) != seq);
+}
 
-			//Average emulating a low-pass filter, considers only left and right microphone phase differences smaller than 1 to reject some noise
-			if(fabs(phase_diff_lr)<1)
-			{
-				mov_avg_lr = A * mov_avg_lr + B * phase_diff_lr;
-			}
 
-			//Same principle is applied to the front back phase differences
-			if(fabs(phase_diff_fb)<1)
-			{
-				mov_avg_fb = A * mov_avg_fb + B * phase_diff_fb;
-			}
-		}
-		//If the frequencies do not match
-		else
+//Copies the results of the selected beacon for the last processed frame, without lock
+void get_audio_snapshot(audio_snapshot_t* dest)
+{
+	get_beacon_snapshot(active_beacon, dest);
+}
+
+
+/*
+*	Replaces the tracked beacons by the nb frequencies [Hz] of hz, takes effect at the next frame.
+*	Returns FALSE if nb is not between 1 and AUDIO_MAX_BEACONS, if a frequency is outside the analyzed band
+*	or if two beacons are closer than their frequency tolerances at the startup frame length. The frames are not
+*	shortened below the length that separates them
+*/
+bool set_audio_beacons(const uint16_t* hz, uint8_t nb)
+{
+	if(nb < 1 || nb > AUDIO_MAX_BEACONS){return FALSE;}
+	for(uint8_t b = 0 ; b < nb ; b++)
+	{
+		if(hz[b] < SOURCE_HZ - BAND_HALF_WIDTH_HZ || hz[b] > SOURCE_HZ + BAND_HALF_WIDTH_HZ){return FALSE;}
+		for(uint8_t other = 0 ; other < b ; other++)
 		{
-			audio_status = NO_AUDIO;
+			if(abs(HZ_TO_BIN(ALIAS_HZ(hz[b]), FFT_SIZE) - HZ_TO_BIN(ALIAS_HZ(hz[other]), FFT_SIZE)) <= 2 * MAX_ERROR(FFT_SIZE)){return FALSE;}
 		}
 	}
+
+	chSysLock();
+	memcpy(pending_hz, hz, nb * sizeof(uint16_t));
+	nb_pending = nb;
+	chSysUnlock();
+	return TRUE;
 }
 
 
-//Resets the moving average to speed up the settling time after a large rotation
-void reset_audio (void)
+/*
+*	Selects the beacon reported by get_angle, get_audio_status, get_audio_snapshot and the other getters.
+*	Returns FALSE, keeping the selection, if beacon is not an index of the list set by set_audio_beacons (the pending
+*	one if it has not been applied yet)
+*/
+bool select_audio_beacon(uint8_t beacon)
 {
-	mov_avg_lr = BASE_LR_VALUE;
-	mov_avg_fb = BASE_FB_VALUE;
+	chSysLock();
+	bool valid = beacon < (nb_pending ? nb_pending : nb_beacons);
+	if(valid){active_beacon = beacon;}
+	chSysUnlock();
+	return valid;
+}
+
+
+/*
+*	Waits until a frame newer than the one of dest is processed and copies its snapshot into dest.
+*	Only one thread may wait at a time.
+*	Returns FALSE if no frame was processed within timeout
+*/
+bool wait_audio_frame(audio_snapshot_t* dest, systime_t timeout)
+{
+	systime_t start = chVTGetSystemTime();
+	systime_t remaining = timeout;
+	uint32_t frame = dest->frame;
+
+	get_audio_snapshot(dest);
+	while(dest->frame == frame)
+	{
+		if(timeout != TIME_INFINITE)
+		{
+			systime_t elapsed = chVTGetSystemTime() - start;
+			if(elapsed >= timeout){return FALSE;}
+			remaining = timeout - elapsed;
+		}
+		//The semaphore may have been left signaled by a frame already copied, the loop then waits again
+		chBSemWaitTimeout(&frame_done_sem, remaining);
+		get_audio_snapshot(dest);
+	}
+	return TRUE;
 }
 
 
 //Returns the current audio status
 uint8_t get_audio_status(void)
 {
-	return audio_status;
+	audio_snapshot_t snap;
+	get_audio_snapshot(&snap);
+	return snap.status;
 }
 
 
-//Returns the current angle
+//Returns the current angle given by the bearing tracker, relative to the current heading of the robot
 float get_angle(void)
 {
-	float angle =0;
+	audio_snapshot_t snap;
+	get_audio_snapshot(&snap);
 	//Checks if the frequency is registered
-	if (audio_status == NO_AUDIO){return 0;}
-	//The angle to sound source is computed from the filtered phase differences. Mov_avg_fb is inverted to correct for the orientation.
-	angle=atan2f(mov_avg_lr,-(mov_avg_fb))*360.0f/(2.0f*PI);
-	return angle;
+	if (snap.status == NO_AUDIO){return 0;}
+	//The robot may have turned since the snapshot
+	return wrap_degrees(snap.angle + snap.heading - robot_heading());
+}
+
+
+//Returns the variance [deg^2] of the tracked angle at the last frame, grown by the time elapsed since its last update
+float get_angle_variance(void)
+{
+	audio_snapshot_t snap;
+	get_audio_snapshot(&snap);
+	return snap.variance;
+}
+
+
+//Returns the audio time [ms] elapsed between the last update of the tracked angle and the last frame
+uint32_t get_angle_age(void)
+{
+	audio_snapshot_t snap;
+	get_audio_snapshot(&snap);
+	return snap.age_ms;
+}
+
+
+//Returns the number of FFT frames processed since startup
+uint32_t get_audio_frame_count(void)
+{
+	return frame_count;
+}
+
+
+//Selects the spectral estimator (ESTIMATOR_FFT or ESTIMATOR_GOERTZEL), takes effect at the next frame
+void set_audio_estimator(uint8_t mode)
+{
+	estimator = mode;
+}
+
+
+/*
+*	Selects the detection mode, DETECTION_TONE or one of the coded beacons, takes effect at the next frames. The coded
+*	beacon is the selected beacon, its code is centered on SOURCE_HZ whatever its frequency, and the other beacons are
+*	not detected meanwhile. The frames then hold one period of the code, set_audio_frame_length is ignored.
+*	Returns FALSE, keeping the mode in use, if the mode is unknown or the coded beacons are not built (AUDIO_CODED_BEACONS)
+*/
+bool set_audio_detection(uint8_t mode)
+{
+	if(mode != DETECTION_TONE && (!AUDIO_CODED_BEACONS || (mode != DETECTION_CHIRP && mode != DETECTION_PN))){return FALSE;}
+	detection = mode;
+	return TRUE;
+}
+
+
+/*
+*	Forces the length of the frames to size samples, or lets it follow the SNR of the selected beacon if size is 0.
+*	Takes effect at the next frames. Returns FALSE if size is not a power of two between AUDIO_FFT_MIN_SIZE and
+*	AUDIO_FFT_MAX_SIZE
+*/
+bool set_audio_frame_length(uint16_t size)
+{
+	if(size && ((size & (size - 1)) || size < MIN_FFT_SIZE || size > MAX_FFT_SIZE)){return FALSE;}
+	forced_size = size;
+	return TRUE;
+}
+
+
+/*
+*	Starts measuring the offsets of the microphones against the beacons, at the given bearing [deg] (positive to the
+*	right) from the robot. The robot must not move and the beacons should cover the band until save_audio_calibration.
+*	The calibration in use is not applied meanwhile
+*/
+void start_audio_calibration(float bearing_deg)
+{
+	chSysLock();
+	calib_bearing = bearing_deg;
+	memset(calib_sum, 0, sizeof(calib_sum));
+	memset(calib_mag, 0, sizeof(calib_mag));
+	memset(calib_frames, 0, sizeof(calib_frames));
+	calibrating = TRUE;
+	chSysUnlock();
+}
+
+
+/*
+*	Ends the measurement started by start_audio_calibration and stores it in the flash, it is applied from the next
+*	frame and at every startup. The correction of each microphone brings its gain and phase to the mean of the four.
+*	The points of the band that no beacon covered take the correction of the nearest measured one.
+*	Returns FALSE, keeping the calibration in use, if no point was measured, if the configuration sector holds other
+*	data or if the flash could not be written
+*/
+bool save_audio_calibration(void)
+{
+	static float sum[CALIB_POINTS][4][2];
+	static float mag[CALIB_POINTS][4];
+	static uint16_t frames[CALIB_POINTS];
+	static audio_calibration_t record;
+	int8_t last = -1;
+
+	chSysLock();
+	calibrating = FALSE;
+	memcpy(sum, calib_sum, sizeof(sum));
+	memcpy(mag, calib_mag, sizeof(mag));
+	memcpy(frames, calib_frames, sizeof(frames));
+	chSysUnlock();
+
+	memset(&record, 0, sizeof(record));
+	record.magic = CALIB_MAGIC;
+	record.source_hz = SOURCE_HZ;
+	record.half_width_hz = BAND_HALF_WIDTH_HZ;
+	for(uint8_t p = 0 ; p < CALIB_POINTS ; p++)
+	{
+		if(frames[p] < CALIB_MIN_FRAMES){continue;}
+		float mean = 0.25f * (mag[p][0] + mag[p][1] + mag[p][2] + mag[p][3]);
+		for(uint8_t mic = 0 ; mic < 4 ; mic++)
+		{
+			//Inverse of the gain and conjugate of the mean phase offset
+			float norm = sqrtf(sum[p][mic][0] * sum[p][mic][0] + sum[p][mic][1] * sum[p][mic][1]);
+			if(norm == 0 || mag[p][mic] == 0){return FALSE;}
+			float scale = mean / mag[p][mic] / norm;
+			record.correction[p][mic][0] = scale * sum[p][mic][0];
+			record.correction[p][mic][1] = -scale * sum[p][mic][1];
+		}
+		last = p;
+	}
+	if(last < 0){return FALSE;}
+
+	//Nearest measured point of the others
+	for(uint8_t p = 0 ; p < CALIB_POINTS ; p++)
+	{
+		if(frames[p] >= CALIB_MIN_FRAMES){continue;}
+		uint8_t nearest = last;
+		for(uint8_t q = 0 ; q < CALIB_POINTS ; q++)
+		{
+			if(frames[q] >= CALIB_MIN_FRAMES && abs(q - p) < abs(nearest - p)){nearest = q;}
+		}
+		memcpy(record.correction[p], record.correction[nearest], sizeof(record.correction[p]));
+	}
+	record.checksum = calibration_checksum(&record);
+
+	if(!calibration_sector_free()){return FALSE;}
+	flash_unlock();
+	flash_sector_erase(_config_start);
+	flash_write(_config_start, &record, sizeof(record));
+	flash_lock();
+
+	//The DSP thread applies what the flash holds, like at the next startup
+	if(!read_calibration(&record)){return FALSE;}
+	chSysLock();
+	pending_calibration = record;
+	calib_pending = TRUE;
+	chSysUnlock();
+	return TRUE;
+}
+
+
+//Returns TRUE if the offsets of the microphones are corrected
+bool is_audio_calibrated(void)
+{
+	return calibrated || calib_pending;
+}
+
+
+/*
+*	Returns the false alarm probability of a CFAR detector with threshold alpha whose noise estimate averages n cells.
+*	The power of a noise-only bin summed over M microphones follows a gamma law of shape M, and the noise estimate
+*	averages N such cells, which gives pfa = sum(k < M) C(NM+k-1, k) t^k / (1+t)^(NM+k) with t = alpha / N.
+*	The running floor of the tones averages about CFAR_FLOOR_FRAMES frames of the training cells, the lags of the
+*	matched filter behave like bins
+*/
+static float cfar_false_alarm(float alpha, float n)
+{
+	float t = alpha / n;
+	float log_term = -n * CFAR_MICS * log1pf(t);
+	float pfa = 0;
+
+	for(uint8_t k = 0 ; k < CFAR_MICS ; k++)
+	{
+		if(k){log_term += logf((n * CFAR_MICS + k - 1) / k * t / (1 + t));}
+		pfa += expf(log_term);
+	}
+	return pfa;
+}
+
+
+//Threshold of a CFAR detector whose noise estimate averages n cells for the false alarm probability pfa
+static float cfar_threshold(float pfa, float n)
+{
+	float low = 0, high = 1000;
+
+	//The false alarm probability decreases with the threshold
+	for(uint8_t i = 0 ; i < 32 ; i++)
+	{
+		float mid = 0.5f * (low + high);
+		if(cfar_false_alarm(mid, n) > pfa){low = mid;}
+		else{high = mid;}
+	}
+	return high;
+}
+
+
+/*
+*	Sets the probability that a noise-only bin exceeds the threshold of the CFAR detector in a frame, or that a frame
+*	without coded beacon exceeds the one of the matched filter, takes effect at the next frame
+*/
+void set_audio_false_alarm(float pfa)
+{
+	cfar_alpha = cfar_threshold(pfa, 2.0f * CFAR_TRAINING_CELLS * CFAR_FLOOR_FRAMES);
+#if AUDIO_CODED_BEACONS
+	//The best of the lags of all the offsets is tested, the lags oversample the band about twice and the offsets the
+	//bins twice
+	code_alpha = cfar_threshold(4 * pfa / (CODE_LAGS * AUDIO_CODE_OFFSETS), (CODE_LAGS - 2 * CODE_GUARD_LAGS - 1) / 2 * CFAR_FLOOR_FRAMES);
+#endif
+}
+
+
+/*
+*	Gives the speeds [step/s] the motors were just set to, the bins of the analyzed band that their noise reaches
+*	are notched from the frames recorded while they turn at these speeds
+*/
+void set_audio_motor_speed(int16_t left, int16_t right)
+{
+	if(left > MOTOR_SPEED_LIMIT){left = MOTOR_SPEED_LIMIT;}
+	if(left < -MOTOR_SPEED_LIMIT){left = -MOTOR_SPEED_LIMIT;}
+	if(right > MOTOR_SPEED_LIMIT){right = MOTOR_SPEED_LIMIT;}
+	if(right < -MOTOR_SPEED_LIMIT){right = -MOTOR_SPEED_LIMIT;}
+	motor_speed[0] = left;
+	motor_speed[1] = right;
+}
+
+
+//Returns the SNR [dB] of the selected beacon in the last frame, at its strongest bin summed over the microphones
+float get_audio_snr(void)
+{
+	audio_snapshot_t snap;
+	get_audio_snapshot(&snap);
+	return snap.snr_db;
+}
+
+
+//Returns the confidence (0 to 1) of the bearing of the last frame, 0 if the source was not detected
+float get_audio_confidence(void)
+{
+	audio_snapshot_t snap;
+	get_audio_snapshot(&snap);
+	return snap.confidence;
+}
+
+
+//Returns the interpolated frequency [Hz] of the selected beacon in the last frame where it was detected
+float get_source_frequency(void)
+{
+	audio_snapshot_t snap;
+	get_audio_snapshot(&snap);
+	return snap.peak_hz;
+}
+
+
+//Selects the bearing estimator (BEARING_PHASE, BEARING_GCC_PHAT or BEARING_SRP_PHAT), takes effect immediately
+void set_bearing_estimator(uint8_t mode)
+{
+	bearing = mode;
+}
+
+
+//Returns the bearing estimator in use
+uint8_t get_bearing_estimator(void)
+{
+	return bearing;
+}
+
+
+//Copies the counters and timings of the DSP thread
+void get_audio_stats(audio_stats_t* dest)
+{
+	chSysLock();
+	*dest = stats;
+	chSysUnlock();
 }
@@ -17,17 +17,137 @@ Adapted from the code given in the EPFL MICRO-315 TP (Spring Semester 2020)
 #define NO_AUDIO			0
 #define AUDIO_DETECTED		1
 
+//Spectral estimators
+#define ESTIMATOR_FFT		0				//Full FFT of every microphone
+#define ESTIMATOR_GOERTZEL	1				//Goertzel algorithm on the analyzed bins only
 
-//Resets the moving average to speed up the settling time after a large rotation
+//Bearing estimators
+#define BEARING_PHASE		0				//Phase differences at the peak
+#define BEARING_GCC_PHAT	1				//GCC-PHAT delays over the analyzed band
+#define BEARING_SRP_PHAT	2				//Steered response power of the four microphones over the analyzed band
+
+//Detection modes, the coded beacons repeat a code spread over the analyzed band instead of a tone
+#define DETECTION_TONE		0				//CFAR detector on the bins of each beacon
+#define DETECTION_CHIRP		1				//Matched filter of a linear chirp sweeping the band
+#define DETECTION_PN		2				//Matched filter of a carrier flipped by a pseudo-random sequence
+
+//Maximum number of beacons tracked at the same time, see set_audio_beacons
+#define AUDIO_MAX_BEACONS	4
+
+
+//Counters and timings of the DSP thread. Durations are in realtime counter ticks
+//(cycles on the robot, see RTC2US), frames are counted when the callback completes them
+typedef struct {
+	uint32_t frames;				//Frames completed by the callback
+	uint32_t processed;				//Frames processed by the DSP thread
+	uint32_t overruns;				//Frames skipped because the DSP thread was still busy with the previous one
+	uint32_t overwritten;			//Frames whose samples were overwritten by the callback before the DSP thread was done
+	rtcnt_t last_frame_rtc;			//Processing time of the last frame
+	rtcnt_t max_frame_rtc;			//Longest processing time of a frame
+} audio_stats_t;
+
+//Results of the last processed frame, copied as a whole by get_audio_snapshot
+typedef struct {
+	uint32_t frame;					//Number of the frame, frames processed since startup
+	systime_t time;					//System time at which the frame was processed
+	uint8_t status;					//NO_AUDIO or AUDIO_DETECTED
+	float angle;					//[deg] Tracked angle, relative to the robot when the snapshot was taken
+	float heading;					//[deg] Heading of the robot from its step counters when the snapshot was taken
+	float variance;					//[deg^2] Variance of the tracked angle at this frame
+	uint32_t age_ms;				//[ms] Audio time elapsed between the last update of the tracked angle and this frame
+	float confidence;				//Confidence (0 to 1) of the bearing of this frame, 0 if the source was not detected
+	float snr_db;					//[dB] SNR of the strongest bin of the beacon in this frame, summed over the microphones
+	float peak_hz;					//[Hz] Interpolated frequency of the beacon in the last frame where it was detected
+	uint16_t frame_length;			//[samples] Length of this frame, it follows the SNR of the selected beacon
+	bool motor_noise;				//A harmonic of the motors fell on the bins of the beacon in this frame, the detection
+									//and the bearing may come from the motors rather than the beacon
+} audio_snapshot_t;
+
+
+//Starts the DSP thread, to be called before mic_start
+void audio_processing_start(void);
+
+//Forgets the tracked bearings of all the beacons, the next frames restart the trackers. The trackers follow the
+//rotations of the robot from its step counters, a reset is only needed when the source or the robot moved away
 void reset_audio (void);
 
-//Callback for the audio processing
+//Callback for the audio processing, only copies the samples for the DSP thread
 void processAudioData(int16_t *data, uint16_t num_samples);
 
 //Returns the current audio status
 uint8_t get_audio_status(void);
 
-//Returns the current angle
+//Returns the current angle given by the bearing tracker, relative to the current heading of the robot
 float get_angle(void);
 
+//Returns the variance [deg^2] of the tracked angle at the last frame, grown by the time elapsed since its last update
+float get_angle_variance(void);
+
+//Returns the audio time [ms] elapsed between the last update of the tracked angle and the last frame
+uint32_t get_angle_age(void);
+
+//Copies the results of the selected beacon for the last processed frame, without lock
+void get_audio_snapshot(audio_snapshot_t* dest);
+
+//Copies the results of beacon for the last processed frame, without lock
+void get_beacon_snapshot(uint8_t beacon, audio_snapshot_t* dest);
+
+//Replaces the tracked beacons by the nb frequencies [Hz] of hz, takes effect at the next frame. FALSE if the list is not valid
+bool set_audio_beacons(const uint16_t* hz, uint8_t nb);
+
+//Selects the beacon reported by get_angle, get_audio_status, get_audio_snapshot and the other getters, FALSE if it is not in the list
+bool select_audio_beacon(uint8_t beacon);
+
+//Waits until a frame newer than the one of dest is processed and copies its snapshot into dest, FALSE on timeout
+bool wait_audio_frame(audio_snapshot_t* dest, systime_t timeout);
+
+//Returns the number of FFT frames processed since startup
+uint32_t get_audio_frame_count(void);
+
+//Selects the spectral estimator (ESTIMATOR_FFT or ESTIMATOR_GOERTZEL), takes effect at the next frame
+void set_audio_estimator(uint8_t mode);
+
+//Selects the detection mode (DETECTION_TONE, DETECTION_CHIRP or DETECTION_PN), takes effect at the next frames.
+//FALSE if the mode is not supported, the coded beacons need frame lengths holding one period of their code
+bool set_audio_detection(uint8_t mode);
+
+//Forces the length of the frames (power of two), or lets it follow the SNR of the selected beacon if 0. FALSE if not supported
+bool set_audio_frame_length(uint16_t size);
+
+//Starts measuring the offsets of the microphones against the beacons at bearing_deg from the robot, which must not move.
+//Each beacon measures the point of the band nearest to its frequency : with a single beacon, its offsets are applied to
+//the whole band, the beacons (or a beacon moved in frequency) must cover the band to follow offsets that vary with it
+void start_audio_calibration(float bearing_deg);
+
+//Stores the offsets measured since start_audio_calibration in the flash and applies them. FALSE if nothing was measured
+//or if the configuration sector of the flash holds other data
+bool save_audio_calibration(void);
+
+//Returns TRUE if the offsets of the microphones are corrected
+bool is_audio_calibrated(void);
+
+//Sets the probability that a noise-only bin exceeds the threshold of the CFAR detector in a frame
+void set_audio_false_alarm(float pfa);
+
+//Gives the speeds [step/s] the motors were just set to, the tones of their noise are notched from the spectra
+void set_audio_motor_speed(int16_t left, int16_t right);
+
+//Returns the SNR [dB] of the selected beacon in the last frame, at its strongest bin summed over the microphones
+float get_audio_snr(void);
+
+//Returns the confidence (0 to 1) of the bearing of the last frame, 0 if the source was not detected
+float get_audio_confidence(void);
+
+//Returns the interpolated frequency [Hz] of the selected beacon in the last frame where it was detected
+float get_source_frequency(void);
+
+//Selects the bearing estimator (BEARING_PHASE, BEARING_GCC_PHAT or BEARING_SRP_PHAT), takes effect immediately
+void set_bearing_estimator(uint8_t mode);
+
+//Returns the bearing estimator in use
+uint8_t get_bearing_estimator(void);
+
+//Copies the counters and timings of the DSP thread
+void get_audio_stats(audio_stats_t* dest);
+
 #endif /* AUDIO_PROCESSING_H */
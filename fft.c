@@ -20,85 +20,395 @@ Code given in the EPFL MICRO-315 TP (Spring Semester 2020)
 #define rcmul(x,y)      (x.real * y.real + x.imag * y.imag)
 #define icmul(x,y)      (x.imag * y.real - x.real * y.imag)
 
+#define GOERTZEL_LANES	4		//Number of bins computed together by doGoertzel
+
+//Minimax polynomial of atan on [0, 1] used by atan2_approx (odd powers 1 to 11, max error 1.8e-6 rad)
+#define ATAN_C1			0.99997726f
+#define ATAN_C3			-0.33262347f
+#define ATAN_C5			0.19354346f
+#define ATAN_C7			-0.11643287f
+#define ATAN_C9			0.05265332f
+#define ATAN_C11		-0.01172120f
+#define ATAN2_EPSILON	1e-30f	//Avoids the division by zero of atan2_approx(0, 0)
+
+//Quarter wave of sine sampled every 2pi/FFT_MAX_SIZE and bit reversal of a byte, built on first use by fft_c
+static float quarter_sine[FFT_MAX_SIZE / 4 + 1];
+static uint8_t bitrev8[256];
+static bool fft_c_tables_ready = FALSE;
+
+static void fft_c_init_tables(void)
+{
+	for(uint16_t k = 0 ; k <= FFT_MAX_SIZE / 4 ; k++)
+	{
+		quarter_sine[k] = (float)sin(2.0 * M_PI * k / FFT_MAX_SIZE);
+	}
+	for(uint16_t i = 0 ; i < 256 ; i++)
+	{
+		uint8_t r = 0;
+		for(uint8_t b = 0 ; b < 8 ; b++)
+		{
+			if(i & (1 << b)){r |= 0x80 >> b;}
+		}
+		bitrev8[i] = r;
+	}
+	fft_c_tables_ready = TRUE;
+}
+
+//Twiddle e^(-j2pi m/FFT_MAX_SIZE) for 0 <= m < FFT_MAX_SIZE/2, read from the quarter wave table
+static inline complex_float twiddle(uint16_t m)
+{
+	complex_float w;
+	if(m <= FFT_MAX_SIZE / 4)
+	{
+		w.real = quarter_sine[FFT_MAX_SIZE / 4 - m];
+		w.imag = -quarter_sine[m];
+	}
+	else
+	{
+		w.real = -quarter_sine[m - FFT_MAX_SIZE / 4];
+		w.imag = -quarter_sine[FFT_MAX_SIZE / 2 - m];
+	}
+	return w;
+}
+
+//Reverses the order of the log2n lower bits of i
+static inline uint16_t bit_reverse(uint16_t i, uint8_t log2n)
+{
+	return (uint16_t)(((bitrev8[i & 0xFF] << 8) | bitrev8[i >> 8]) >> (16 - log2n));
+}
+
 /* 
 *
-*	FFT written in C
-*	Litterally no optimisation at all
+*	Portable FFT written in C, radix-2^2 decimation in time
+*	Twiddles come from a precomputed quarter wave table and the reordering from a bit reversal table
+*	Two radix-2 stages are merged in each pass (one more radix-2 pass if log2(lx) is odd), which
+*	needs only the twiddles W^k and W^2k and halves the number of passes over the data
+*	
+*	signi gives the sign of the exponent : -1 for the forward transform (same convention as arm_cfft_f32),
+*	+1 for the inverse transform, which is not scaled
+*	lx must be a power of two up to FFT_MAX_SIZE, otherwise the system is halted
 *	
 *	Processing occurs in-place
 *
 */
 int fft_c(int lx, complex_float* cx, float signi)
 {
-	/* Declare all local variables */
-	int i, j, k, m, istep;
-	float arg;
-	complex_float cw;		// Butterfly coefficient
 	complex_float ct;		// Temp coefficient
 
-	j = 0;
-	k = 1;
-	
+	if(lx < 2 || lx > FFT_MAX_SIZE || (lx & (lx - 1)))
+		chSysHalt("FFT size not supported");
+	if(!fft_c_tables_ready)
+		fft_c_init_tables();
+
+	uint8_t log2n = __builtin_ctz(lx);
+	//The inverse transform uses the conjugate twiddles
+	float conj = (signi > 0) ? -1.0f : 1.0f;
+
 	// Reorder the coefficients in bit reverse order
-	for(i=0; i<lx; i++){
-		if (i <= j){
-			// Swap coefficients
-			ct.real = cx[j].real;
-			ct.imag = cx[j].imag;
-			cx[j].real = cx[i].real;
-			cx[j].imag = cx[i].imag;
-			cx[i].real = ct.real;
-			cx[i].imag = ct.imag;
+	for(uint16_t i = 0 ; i < lx ; i++)
+	{
+		uint16_t j = bit_reverse(i, log2n);
+		if(i < j)
+		{
+			ct = cx[j];
+			cx[j] = cx[i];
+			cx[i] = ct;
 		}
-		m = lx/2;
-		while (j > m-1){
-			j = j - m;
-			m = m/2;
-			if (m < 1)
-				break;
+	}
+
+	uint16_t len = 1;
+	// Odd number of radix-2 stages, the first one only has trivial twiddles
+	if(log2n & 1)
+	{
+		for(uint16_t i = 0 ; i < lx ; i += 2)
+		{
+			ct = cx[i+1];
+			cx[i+1].real = cx[i].real - ct.real;
+			cx[i+1].imag = cx[i].imag - ct.imag;
+			cx[i].real += ct.real;
+			cx[i].imag += ct.imag;
 		}
-		j = j + m;
+		len = 2;
 	}
-	
-	// Do the FFT
-	do{
-		istep = 2*k;
-		// Do a k points DFT
-		for (m=0; m<k; m++){
-			// Butterfly coefficients W(n,N)
-			arg = 3.14159265*signi*m/k;
-			cw.real = (float)(cos((double)(arg)));
-			cw.imag = (float)(sin((double)(arg)));
-			// Do the butterfly algorithm
-			for (i=m; i<lx; i+=istep){
-				ct.real = rmul(cw, cx[i+k]);
-				ct.imag = imul(cw, cx[i+k]);
-				cx[i+k].real = cx[i].real - ct.real;
-				cx[i+k].imag = cx[i].imag - ct.imag;
-				cx[i].real = cx[i].real + ct.real;
-				cx[i].imag = cx[i].imag + ct.imag;
+
+	// Each pass merges 4 DFTs of len points into one of 4*len points
+	for( ; len < lx ; len *= 4)
+	{
+		uint16_t step = FFT_MAX_SIZE / (4 * len);
+		for(uint16_t k = 0 ; k < len ; k++)
+		{
+			// Butterfly coefficients W(k,4len) and W(2k,4len)
+			complex_float w1 = twiddle(k * step);
+			complex_float w2 = twiddle(2 * k * step);
+			w1.imag *= conj;
+			w2.imag *= conj;
+
+			for(uint16_t i = k ; i < lx ; i += 4 * len)
+			{
+				complex_float a = cx[i], b = cx[i + len], c = cx[i + 2*len], d = cx[i + 3*len];
+				complex_float e0, e1, o0, o1;
+
+				// First radix-2 stage : two DFTs of 2len points
+				ct.real = rmul(w2, b);
+				ct.imag = imul(w2, b);
+				e0.real = a.real + ct.real;		e0.imag = a.imag + ct.imag;
+				e1.real = a.real - ct.real;		e1.imag = a.imag - ct.imag;
+				ct.real = rmul(w2, d);
+				ct.imag = imul(w2, d);
+				o0.real = c.real + ct.real;		o0.imag = c.imag + ct.imag;
+				o1.real = c.real - ct.real;		o1.imag = c.imag - ct.imag;
+
+				// Second radix-2 stage, W(len,4len) = -j (+j for the inverse transform)
+				ct.real = rmul(w1, o0);
+				ct.imag = imul(w1, o0);
+				cx[i].real = e0.real + ct.real;				cx[i].imag = e0.imag + ct.imag;
+				cx[i + 2*len].real = e0.real - ct.real;		cx[i + 2*len].imag = e0.imag - ct.imag;
+				ct.real = conj * imul(w1, o1);
+				ct.imag = -conj * rmul(w1, o1);
+				cx[i + len].real = e1.real + ct.real;		cx[i + len].imag = e1.imag + ct.imag;
+				cx[i + 3*len].real = e1.real - ct.real;		cx[i + 3*len].imag = e1.imag - ct.imag;
 			}
 		}
-		k = istep;
-	}while (k < lx);
+	}
 	
 	return(0);
 }
 
+//CMSIS complex FFT instances indexed by the log2 of their size
+static const arm_cfft_instance_f32* const cfft_instances[FFT_MAX_LOG2 + 1] = {
+	[4] = &arm_cfft_sR_f32_len16,
+	[5] = &arm_cfft_sR_f32_len32,
+	[6] = &arm_cfft_sR_f32_len64,
+	[7] = &arm_cfft_sR_f32_len128,
+	[8] = &arm_cfft_sR_f32_len256,
+	[9] = &arm_cfft_sR_f32_len512,
+	[10] = &arm_cfft_sR_f32_len1024,
+	[11] = &arm_cfft_sR_f32_len2048,
+	[12] = &arm_cfft_sR_f32_len4096,
+};
+
+/*
+*	Returns the CMSIS complex FFT instance of the given size
+*	The size must be a power of two between FFT_MIN_SIZE and FFT_MAX_SIZE, otherwise the system is halted
+*	Callers on a hot path can fetch the instance once and call arm_cfft_f32 themselves
+*/
+const arm_cfft_instance_f32* get_cfft_instance(uint16_t size){
+	if(size < FFT_MIN_SIZE || size > FFT_MAX_SIZE || (size & (size - 1)))
+		chSysHalt("FFT size not supported");
+
+	return cfft_instances[__builtin_ctz(size)];
+}
+
+//CMSIS Q15 complex FFT instances indexed by the log2 of their size
+static const arm_cfft_instance_q15* const cfft_q15_instances[FFT_MAX_LOG2 + 1] = {
+	[4] = &arm_cfft_sR_q15_len16,
+	[5] = &arm_cfft_sR_q15_len32,
+	[6] = &arm_cfft_sR_q15_len64,
+	[7] = &arm_cfft_sR_q15_len128,
+	[8] = &arm_cfft_sR_q15_len256,
+	[9] = &arm_cfft_sR_q15_len512,
+	[10] = &arm_cfft_sR_q15_len1024,
+	[11] = &arm_cfft_sR_q15_len2048,
+	[12] = &arm_cfft_sR_q15_len4096,
+};
+
+/*
+*	Returns the CMSIS Q15 complex FFT instance of the given size, same sizes as get_cfft_instance
+*/
+const arm_cfft_instance_q15* get_cfft_q15_instance(uint16_t size){
+	if(size < FFT_MIN_SIZE || size > FFT_MAX_SIZE || (size & (size - 1)))
+		chSysHalt("FFT size not supported");
+
+	return cfft_q15_instances[__builtin_ctz(size)];
+}
+
 /*
 *	Wrapper to call a very optimized fft function provided by ARM
 *	which uses a lot of tricks to optimize the computations
+*	Any size supported by get_cfft_instance, the instance is found with a table lookup
 */
 void doFFT_optimized(uint16_t size, float* complex_buffer){
-	if(size == 1024)
-		arm_cfft_f32(&arm_cfft_sR_f32_len1024, complex_buffer, 0, 1);
-	
+	arm_cfft_f32(get_cfft_instance(size), complex_buffer, 0, 1);
 }
 
 /*
-*	Wrapper to call the non optimized FFT function
+*	Wrapper to call the ARM fixed-point complex FFT on interleaved Q15 data
+*	The output is scaled down by size to avoid overflows (11.5 format with 1024 points)
+*/
+void doFFT_q15(uint16_t size, q15_t* complex_buffer){
+	arm_cfft_q15(get_cfft_q15_instance(size), complex_buffer, 0, 1);
+}
+
+/*
+*	Wrapper to call the ARM real FFT, half the work of a complex FFT of the same length
+*	The real_buffer is used as scratch and the output holds the bins 0 to size/2-1 as [real, imag] pairs,
+*	like the first half of a complex FFT, except that the imaginary part of bin 0 is replaced by the
+*	(real) bin size/2
+*	The size must be a power of two between 2 * FFT_MIN_SIZE and FFT_MAX_SIZE, otherwise the system is halted
+*/
+void doRFFT_optimized(uint16_t size, float* real_buffer, float* complex_output){
+	static arm_rfft_fast_instance_f32 rfft_instance;
+	static uint16_t rfft_size = 0;
+
+	//The instance only has to be initialized when the size changes
+	if(size != rfft_size)
+	{
+		if(arm_rfft_fast_init_f32(&rfft_instance, size) != ARM_MATH_SUCCESS)
+			chSysHalt("RFFT size not supported");
+		rfft_size = size;
+	}
+	arm_rfft_fast_f32(&rfft_instance, real_buffer, complex_output, 0);
+}
+
+/*
+*	Wrapper to call the portable FFT function, forward transform with the same convention as doFFT_optimized
 */
 void doFFT_c(uint16_t size, complex_float* complex_buffer){
 
+	fft_c(size, complex_buffer, -1.);
+}
+
+/*
+*	Wrapper to call the portable inverse FFT function, scaled by 1/size like arm_cfft_f32
+*/
+void doIFFT_c(uint16_t size, complex_float* complex_buffer){
+	float scale = 1.0f / size;
+
 	fft_c(size, complex_buffer, +1.);
+	for(uint16_t i = 0 ; i < size ; i++)
+	{
+		complex_buffer[i].real *= scale;
+		complex_buffer[i].imag *= scale;
+	}
+}
+
+//Coefficients of one group of GOERTZEL_LANES bins, the unused lanes of the last group compute bin 0
+static void goertzel_coefficients(uint16_t size, const uint16_t* bins, uint16_t nb_left, float* cosw, float* sinw, float* coeff)
+{
+	for(uint8_t l = 0 ; l < GOERTZEL_LANES ; l++)
+	{
+		float w = (l < nb_left) ? 2.0f * PI * bins[l] / size : 0;
+		cosw[l] = cosf(w);
+		sinw[l] = sinf(w);
+		coeff[l] = 2.0f * cosw[l];
+	}
+}
+
+//Final complex step of one group, gives the same value as the DFT at each bin
+static void goertzel_output(float* complex_output, uint16_t nb_left, const float* cosw, const float* sinw, const float* s1, const float* s2)
+{
+	for(uint8_t l = 0 ; l < GOERTZEL_LANES && l < nb_left ; l++)
+	{
+		complex_output[2*l] = cosw[l] * s1[l] - s2[l];
+		complex_output[2*l+1] = sinw[l] * s1[l];
+	}
+}
+
+//Sample i of a buffer of float or Q15 values, converted to float for the recursions
+static inline float sample_f32(const void* buffer, uint32_t i)
+{
+	return ((const float*)buffer)[i];
+}
+
+static inline float sample_q15(const void* buffer, uint32_t i)
+{
+	return ((const q15_t*)buffer)[i];
+}
+
+/*
+*	Recursions shared by doGoertzel and doGoertzel_q15, the samples are read with sample. Inlined in both
+*	so that the conversion of each sample is not an indirect call
+*/
+static inline void goertzel_groups(uint16_t size, const void* buffer, uint16_t stride, float (*sample)(const void*, uint32_t),
+									const uint16_t* bins, uint16_t nb_bins, float* complex_output)
+{
+	for(uint16_t b = 0 ; b < nb_bins ; b += GOERTZEL_LANES)
+	{
+		float cosw[GOERTZEL_LANES], sinw[GOERTZEL_LANES], coeff[GOERTZEL_LANES];
+		float s1[GOERTZEL_LANES] = {0}, s2[GOERTZEL_LANES] = {0};
+
+		goertzel_coefficients(size, &bins[b], nb_bins - b, cosw, sinw, coeff);
+
+		//Second order recursions, one multiplication per sample and per bin
+		for(uint32_t i = 0 ; i < (uint32_t)size * stride ; i += stride)
+		{
+			float x = sample(buffer, i);
+			for(uint8_t l = 0 ; l < GOERTZEL_LANES ; l++)
+			{
+				float s0 = x + coeff[l] * s1[l] - s2[l];
+				s2[l] = s1[l];
+				s1[l] = s0;
+			}
+		}
+
+		goertzel_output(&complex_output[2*b], nb_bins - b, cosw, sinw, s1, s2);
+	}
+}
+
+/*
+*	Goertzel algorithm computing only the requested bins of a size-point DFT of a real signal
+*	The bins are processed GOERTZEL_LANES at a time so that every sample is loaded only once
+*	per group and the independent recursions can be interleaved by the FPU
+*	
+*	params :
+*	uint16_t size			Length of the DFT (number of samples)
+*	float *buffer			Real samples, one every stride values
+*	uint16_t stride			Distance between two consecutive samples in the buffer
+*	const uint16_t *bins	Indices of the bins to compute
+*	uint16_t nb_bins		Number of bins to compute
+*	float *complex_output	Receives the nb_bins complex values [real, imag] with the arm_cfft_f32 sign convention
+*/
+void doGoertzel(uint16_t size, float* buffer, uint16_t stride, const uint16_t* bins, uint16_t nb_bins, float* complex_output)
+{
+	goertzel_groups(size, buffer, stride, sample_f32, bins, nb_bins, complex_output);
+}
+
+/*
+*	Same as doGoertzel on Q15 samples, the recursions are done in floating point
+*	and the output has the scale of the samples (not the one of arm_cfft_q15)
+*/
+void doGoertzel_q15(uint16_t size, q15_t* buffer, uint16_t stride, const uint16_t* bins, uint16_t nb_bins, float* complex_output)
+{
+	goertzel_groups(size, buffer, stride, sample_q15, bins, nb_bins, complex_output);
+}
+
+/*
+*	Branch-free approximation of atan2f on arrays, max error about 2e-6 rad
+*	The ratio is reduced to [0, 1] with min/max selects, and the octant is unfolded with selects and copysignf,
+*	so the loop has no data dependent branch and can be vectorized by the compiler
+*	
+*	params :
+*	const float *y, *x	Coordinates of the n points, in the order of atan2f
+*	float *angle		Receives the n angles in [-PI, PI]
+*/
+void atan2_approx(const float* y, const float* x, float* angle, uint16_t n)
+{
+	for(uint16_t i = 0 ; i < n ; i++)
+	{
+		float ax = fabsf(x[i]), ay = fabsf(y[i]);
+		//Selects rather than fminf/fmaxf, which are library calls without -ffast-math
+		float a = ((ax < ay) ? ax : ay) / (((ax < ay) ? ay : ax) + ATAN2_EPSILON);
+		float s = a * a;
+		float r = a * (ATAN_C1 + s * (ATAN_C3 + s * (ATAN_C5 + s * (ATAN_C7 + s * (ATAN_C9 + s * ATAN_C11)))));
+
+		//Unfolds the octant : |y| > |x|, then x < 0, then the sign of y
+		r = (ay > ax) ? (PI / 2 - r) : r;
+		r = (x[i] < 0) ? (PI - r) : r;
+		angle[i] = copysignf(r, y[i]);
+	}
+}
+
+/*
+*	Offset in bins, between -0.5 and 0.5, of the vertex of the parabola through three consecutive
+*	values whose middle one is the largest. Returns 0 if the three values do not form a peak
+*/
+float parabolic_peak_offset(float left, float center, float right)
+{
+	float denom = left - 2.0f * center + right;
+	if(denom >= 0){return 0;}
+
+	float offset = 0.5f * (left - right) / denom;
+	if(offset > 0.5f){offset = 0.5f;}
+	if(offset < -0.5f){offset = -0.5f;}
+	return offset;
 }
@@ -8,14 +8,38 @@ Code given in the EPFL MICRO-315 TP (Spring Semester 2020)
 #ifndef FFT_H
 #define FFT_H
 
+#include <arm_math.h>
+
+//Sizes supported by the CMSIS FFT tables
+#define FFT_MIN_SIZE	16
+#define FFT_MAX_SIZE	4096
+#define FFT_MAX_LOG2	12
 
 typedef struct complex_float{
 	float real;
 	float imag;
 }complex_float;
 
+const arm_cfft_instance_f32* get_cfft_instance(uint16_t size);
+
 void doFFT_optimized(uint16_t size, float* complex_buffer);
 
+void doRFFT_optimized(uint16_t size, float* real_buffer, float* complex_output);
+
+const arm_cfft_instance_q15* get_cfft_q15_instance(uint16_t size);
+
+void doFFT_q15(uint16_t size, q15_t* complex_buffer);
+
 void doFFT_c(uint16_t size, complex_float* complex_buffer);
 
+void doIFFT_c(uint16_t size, complex_float* complex_buffer);
+
+void doGoertzel(uint16_t size, float* buffer, uint16_t stride, const uint16_t* bins, uint16_t nb_bins, float* complex_output);
+
+void doGoertzel_q15(uint16_t size, q15_t* buffer, uint16_t stride, const uint16_t* bins, uint16_t nb_bins, float* complex_output);
+
+void atan2_approx(const float* y, const float* x, float* angle, uint16_t n);
+
+float parabolic_peak_offset(float left, float center, float right);
+
 #endif /* FFT_H */
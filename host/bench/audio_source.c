@@ -0,0 +1,285 @@
+/*
+
+File    : audio_source.c
+
+Microphone data sources for the host harnesses : recorded PCM files or a synthesized beacon
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "audio_source.h"
+
+#define SPEED_OF_SOUND			343.0f	//[m/s]
+#define MIC_LR_RADIUS			0.030f	//[m] Distance of the left and right microphones to the center of the robot
+#define MIC_FB_RADIUS			0.014f	//[m] Same for the front and back microphones, gives BASE_FB_VALUE at 990Hz
+#define DEG_PER_STEP			(130.0f / 1000 / 53.5f * 180.0f / (float)M_PI)	//[deg] Rotation of the e-puck2 for a difference of one step between the wheels
+
+const char audio_source_usage[] =
+	"  -i FILE        replay a recording (raw int16 [right, left, back, front] chunks)\n"
+	"  --angle DEG    synthesized beacon bearing, positive to the right (default 0)\n"
+	"  --freq HZ      synthesized beacon frequency (default 990)\n"
+	"  --amp A        synthesized beacon amplitude (default 2000)\n"
+	"  --tone HZ:DEG  additional synthesized beacon, up to 3\n"
+	"  --code NAME    waveform of the synthesized beacon : tone (default), chirp or pn, centered on --freq\n"
+	"  --echo MS:G:DEG  echo of the synthesized beacon MS ms after it, of relative amplitude G, from DEG\n"
+	"  --noise SIGMA  white noise standard deviation (default 200)\n"
+	"  --spin DEG/S   rotation of the synthesized robot, clockwise (default 0)\n"
+	"  --motor R:A    wheels at R step/s, synthesized motor noise of amplitude A (default 0:0)\n"
+	"  --mic-phase P,P,P,P  phase offsets [deg] of the right, left, back and front microphones (default 0)\n"
+	"  --mic-gain G,G,G,G   gains of the right, left, back and front microphones (default 1)\n"
+	"  --seconds S    synthesized duration (default 5)\n"
+	"  --seed N       noise generator seed (default 1)\n";
+
+
+//Position of each microphone in the robot frame (x forward, y to the left), indexed by MIC_xxx
+static const float mic_pos[4][2] = {
+	[MIC_RIGHT] = {0, -MIC_LR_RADIUS},
+	[MIC_LEFT]  = {0, MIC_LR_RADIUS},
+	[MIC_BACK]  = {-MIC_FB_RADIUS, 0},
+	[MIC_FRONT] = {MIC_FB_RADIUS, 0},
+};
+
+
+//xorshift32 generator, deterministic across platforms
+static uint32_t next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+
+//Standard normal variate (Box-Muller)
+static float gaussian(uint32_t *state)
+{
+	float u1 = (next_random(state) + 1.0f) / 4294967296.0f;
+	float u2 = next_random(state) / 4294967296.0f;
+	return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * (float)M_PI * u2);
+}
+
+
+//Main beacon at time t [s] of unit amplitude : the tone, or the code repeated every SYNTH_CODE_PERIOD samples
+static double beacon_signal(const synth_config_t *cfg, double t)
+{
+	double period = (double)SYNTH_CODE_PERIOD / AUDIO_SAMPLE_RATE;
+	double u = t - floor(t / period) * period;
+
+	if(cfg->code == SYNTH_CHIRP)
+	{
+		return cos(2.0 * M_PI * ((cfg->freq - SYNTH_CODE_HALF_WIDTH_HZ) * u + SYNTH_CODE_HALF_WIDTH_HZ * u * u / period));
+	}
+	if(cfg->code == SYNTH_PN)
+	{
+		uint8_t chip = (uint8_t)(u * SYNTH_CODE_CHIPS / period);
+		double x = cos(2.0 * M_PI * cfg->freq * u);
+		return ((SYNTH_CODE_SEQUENCE >> chip) & 1) ? -x : x;
+	}
+	return sin(2.0 * M_PI * cfg->freq * t);
+}
+
+
+static int16_t saturate(float x)
+{
+	if(x > INT16_MAX){return INT16_MAX;}
+	if(x < INT16_MIN){return INT16_MIN;}
+	return (int16_t)lrintf(x);
+}
+
+
+void audio_source_default_synth(synth_config_t *config)
+{
+	config->angle = 0;
+	config->freq = 990;
+	config->amplitude = 2000;
+	config->code = SYNTH_TONE;
+	config->echo_delay = 0;
+	config->echo_gain = 0;
+	config->echo_angle = 0;
+	config->nb_tones = 0;
+	config->noise = 200;
+	config->spin = 0;
+	config->motor_rate = 0;
+	config->motor_amp = 0;
+	for(uint8_t mic = 0 ; mic < 4 ; mic++)
+	{
+		config->mic_phase[mic] = 0;
+		config->mic_gain[mic] = 1;
+	}
+	config->seconds = 5;
+	config->seed = 1;
+}
+
+
+int audio_source_open_file(audio_source_t *src, const char *path, const synth_config_t *config)
+{
+	memset(src, 0, sizeof(*src));
+	src->synth = *config;
+	src->file = fopen(path, "rb");
+	return src->file ? 0 : -1;
+}
+
+
+void audio_source_open_synth(audio_source_t *src, const synth_config_t *config)
+{
+	memset(src, 0, sizeof(*src));
+	src->synth = *config;
+	src->nb_chunks = (uint32_t)(config->seconds * AUDIO_SAMPLE_RATE / AUDIO_CHUNK_SAMPLES);
+	src->rng = config->seed ? config->seed : 1;
+}
+
+
+int audio_source_read(audio_source_t *src, int16_t *chunk)
+{
+	if(src->file)
+	{
+		uint8_t raw[2 * MIC_BUFFER_LEN];
+		if(fread(raw, sizeof(raw), 1, src->file) != 1){return 0;}
+		//Recordings are little-endian whatever the host
+		for(uint16_t i = 0 ; i < MIC_BUFFER_LEN ; i++)
+		{
+			chunk[i] = (int16_t)(raw[2*i] | (raw[2*i+1] << 8));
+		}
+		src->chunk++;
+		return 1;
+	}
+
+	if(src->chunk >= src->nb_chunks){return 0;}
+
+	//Delay of each microphone relative to the center of the robot for a plane wave. On the robot the
+	//phases measured by the firmware are lower on the microphone facing the source (BASE_FB_VALUE < 0
+	//and get_angle were calibrated that way), the sign of the delays reproduces this convention
+	const synth_config_t *cfg = &src->synth;
+	float freq[1 + SYNTH_MAX_TONES], delay[1 + SYNTH_MAX_TONES][4], echo_delay[4];
+
+	for(uint16_t n = 0 ; n < AUDIO_CHUNK_SAMPLES ; n++)
+	{
+		double t = (double)(src->chunk * AUDIO_CHUNK_SAMPLES + n) / AUDIO_SAMPLE_RATE;
+		//The bearings only change at every sample when the robot turns
+		for(uint8_t tone = 0 ; tone <= cfg->nb_tones && (n == 0 || cfg->spin != 0) ; tone++)
+		{
+			float bearing = ((tone ? cfg->tone_angle[tone-1] : cfg->angle) - cfg->spin * (float)t) * (float)M_PI / 180.0f;
+			float ux = cosf(bearing), uy = -sinf(bearing);
+			freq[tone] = tone ? cfg->tone_freq[tone-1] : cfg->freq;
+			for(uint8_t mic = 0 ; mic < 4 ; mic++)
+			{
+				delay[tone][mic] = (mic_pos[mic][0] * ux + mic_pos[mic][1] * uy) / SPEED_OF_SOUND;
+			}
+		}
+		//The echo of the main beacon comes from its own bearing
+		if(n == 0 || cfg->spin != 0)
+		{
+			float bearing = (cfg->echo_angle - cfg->spin * (float)t) * (float)M_PI / 180.0f;
+			for(uint8_t mic = 0 ; mic < 4 ; mic++)
+			{
+				echo_delay[mic] = cfg->echo_delay + (mic_pos[mic][0] * cosf(bearing) - mic_pos[mic][1] * sinf(bearing)) / SPEED_OF_SOUND;
+			}
+		}
+		for(uint8_t mic = 0 ; mic < 4 ; mic++)
+		{
+			float x = cfg->noise * gaussian(&src->rng);
+			//The offsets of the microphone are the same for every beacon
+			double phase = cfg->mic_phase[mic] * M_PI / 180.0;
+			//The offsets of the microphones are applied to the codes and the echo as if they were tones at freq
+			x += cfg->amplitude * cfg->mic_gain[mic] * (float)beacon_signal(cfg, t - delay[0][mic] + phase / (2.0 * M_PI * cfg->freq));
+			if(cfg->echo_gain != 0)
+			{
+				x += cfg->echo_gain * cfg->amplitude * cfg->mic_gain[mic] * (float)beacon_signal(cfg, t - echo_delay[mic] + phase / (2.0 * M_PI * cfg->freq));
+			}
+			for(uint8_t tone = 1 ; tone <= cfg->nb_tones ; tone++)
+			{
+				x += cfg->amplitude * cfg->mic_gain[mic] * (float)sin(2.0 * M_PI * freq[tone] * (t - delay[tone][mic]) + phase);
+			}
+			//The noise of the motors reaches each microphone through the body, with its own phase
+			for(uint8_t h = 1 ; h <= SYNTH_MOTOR_HARMONICS && cfg->motor_amp != 0 ; h++)
+			{
+				double phase = 2.0 * M_PI * fmod(0.618 * (mic + 1) * h, 1.0);
+				x += cfg->motor_amp / h * (float)sin(2.0 * M_PI * h * cfg->motor_rate * t + phase);
+			}
+			chunk[4*n + mic] = saturate(x);
+		}
+	}
+	src->chunk++;
+	return 1;
+}
+
+
+float audio_source_heading(const audio_source_t *src)
+{
+	return src->synth.spin * src->chunk * AUDIO_CHUNK_SAMPLES / AUDIO_SAMPLE_RATE;
+}
+
+
+void audio_source_steps(const audio_source_t *src, int32_t *left, int32_t *right)
+{
+	float t = (float)src->chunk * AUDIO_CHUNK_SAMPLES / AUDIO_SAMPLE_RATE;
+	//The left wheel turns forward when the robot turns clockwise
+	*left = (int32_t)lrintf(src->synth.motor_rate * t + audio_source_heading(src) / DEG_PER_STEP);
+	*right = (int32_t)lrintf(src->synth.motor_rate * t);
+}
+
+
+void audio_source_close(audio_source_t *src)
+{
+	if(src->file){fclose(src->file);}
+	src->file = NULL;
+}
+
+
+int audio_source_parse_arg(int argc, char **argv, synth_config_t *config, const char **path)
+{
+	if(argc < 2){return 0;}
+	const char *opt = argv[0];
+	const char *val = argv[1];
+
+	if(!strcmp(opt, "-i")){*path = val;}
+	else if(!strcmp(opt, "--angle")){config->angle = strtof(val, NULL);}
+	else if(!strcmp(opt, "--freq")){config->freq = strtof(val, NULL);}
+	else if(!strcmp(opt, "--amp")){config->amplitude = strtof(val, NULL);}
+	else if(!strcmp(opt, "--noise")){config->noise = strtof(val, NULL);}
+	else if(!strcmp(opt, "--spin")){config->spin = strtof(val, NULL);}
+	else if(!strcmp(opt, "--motor"))
+	{
+		char *end;
+		config->motor_rate = strtof(val, &end);
+		config->motor_amp = (*end == ':') ? strtof(end + 1, NULL) : 0;
+	}
+	else if(!strcmp(opt, "--mic-phase") || !strcmp(opt, "--mic-gain"))
+	{
+		float *values = (opt[6] == 'p') ? config->mic_phase : config->mic_gain;
+		char *next = (char *)val;
+		for(uint8_t mic = 0 ; mic < 4 && *next ; mic++)
+		{
+			values[mic] = strtof(next, &next);
+			if(*next == ','){next++;}
+		}
+	}
+	else if(!strcmp(opt, "--code"))
+	{
+		if(!strcmp(val, "tone")){config->code = SYNTH_TONE;}
+		else if(!strcmp(val, "chirp")){config->code = SYNTH_CHIRP;}
+		else if(!strcmp(val, "pn")){config->code = SYNTH_PN;}
+		else{return 0;}
+	}
+	else if(!strcmp(opt, "--echo"))
+	{
+		char *end;
+		config->echo_delay = strtof(val, &end) / 1000.0f;
+		config->echo_gain = (*end == ':') ? strtof(end + 1, &end) : 0;
+		config->echo_angle = (*end == ':') ? strtof(end + 1, NULL) : 0;
+	}
+	else if(!strcmp(opt, "--seconds")){config->seconds = strtof(val, NULL);}
+	else if(!strcmp(opt, "--seed")){config->seed = (uint32_t)strtoul(val, NULL, 0);}
+	else if(!strcmp(opt, "--tone") && config->nb_tones < SYNTH_MAX_TONES)
+	{
+		char *end;
+		config->tone_freq[config->nb_tones] = strtof(val, &end);
+		config->tone_angle[config->nb_tones] = (*end == ':') ? strtof(end + 1, NULL) : 0;
+		config->nb_tones++;
+	}
+	else{return 0;}
+	return 2;
+}
@@ -0,0 +1,92 @@
+/*
+
+File    : audio_source.h
+
+Microphone data sources for the host harnesses : recorded PCM files or a synthesized beacon.
+Recordings are raw little-endian int16 files holding the interleaved [right, left, back, front]
+samples exactly as mic_start delivers them (MIC_BUFFER_LEN values per 10ms chunk).
+*/
+
+#ifndef AUDIO_SOURCE_H
+#define AUDIO_SOURCE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <audio/microphone.h>
+
+#define AUDIO_SAMPLE_RATE		16000	//[Hz]
+#define AUDIO_CHUNK_SAMPLES		(MIC_BUFFER_LEN / 4)	//Samples per microphone in one chunk
+
+#define SYNTH_MAX_TONES		3		//Beacons synthesized in addition to the main one
+#define SYNTH_MOTOR_HARMONICS	8		//Harmonics of the synthesized noise of the motors
+//Coded beacons, the defaults of the matched filter of audio_processing.c : period, half sweep of the chirp and
+//sequence of the chips that invert the carrier
+#define SYNTH_CODE_PERIOD		1024	//[samples]
+#define SYNTH_CODE_HALF_WIDTH_HZ	200	//[Hz]
+#define SYNTH_CODE_CHIPS		15
+#define SYNTH_CODE_SEQUENCE		0x7591
+
+//Waveforms of the main beacon
+#define SYNTH_TONE				0
+#define SYNTH_CHIRP				1		//Linear chirp sweeping freq +- SYNTH_CODE_HALF_WIDTH_HZ over each period
+#define SYNTH_PN				2		//Carrier at freq inverted by the chips of SYNTH_CODE_SEQUENCE
+
+//Synthetic beacon, the bearing is in degrees, positive when the source is on the right of the robot
+typedef struct {
+	float angle;			//[degrees]
+	float freq;				//[Hz]
+	float amplitude;		//Peak amplitude of the tone, also used by the additional beacons
+	uint8_t code;			//SYNTH_xxx waveform of the main beacon, the additional beacons are tones
+	float echo_delay;		//[s] Delay of the echo of the main beacon, after the direct path
+	float echo_gain;		//Amplitude of the echo relative to the direct path, 0 for none
+	float echo_angle;		//[degrees] Bearing of the echo
+	uint8_t nb_tones;		//Additional beacons
+	float tone_freq[SYNTH_MAX_TONES];	//[Hz]
+	float tone_angle[SYNTH_MAX_TONES];	//[degrees]
+	float noise;			//Standard deviation of the white noise added to every microphone
+	float spin;				//[degrees/s] Rotation of the robot, clockwise : the bearings of all the beacons decrease at this rate
+	float motor_rate;		//[step/s] Speed of both wheels, the noise of the motors has a period of one step
+	float motor_amp;		//Amplitude of the fundamental of the noise of the motors, harmonic h has motor_amp / h
+	float mic_phase[4];		//[degrees] Phase offset of each microphone (indexed by MIC_xxx), added to the beacons
+	float mic_gain[4];		//Gain of each microphone applied to the beacons
+	float seconds;			//Duration of the signal
+	uint32_t seed;			//Seed of the noise generator
+} synth_config_t;
+
+typedef struct {
+	FILE *file;				//Recording, NULL for a synthesized source
+	synth_config_t synth;
+	uint32_t chunk;			//Index of the next chunk
+	uint32_t nb_chunks;		//Total number of chunks of a synthesized source
+	uint32_t rng;
+} audio_source_t;
+
+//Fills a synth_config_t with a clean 990Hz beacon straight ahead
+void audio_source_default_synth(synth_config_t *config);
+
+//Opens a recording made while the robot moved as described by the spin and motor_rate of config, returns 0 on success
+int audio_source_open_file(audio_source_t *src, const char *path, const synth_config_t *config);
+
+//Initializes a synthesized source
+void audio_source_open_synth(audio_source_t *src, const synth_config_t *config);
+
+//Reads the next chunk of MIC_BUFFER_LEN values, returns 0 at the end of the source
+int audio_source_read(audio_source_t *src, int16_t *chunk);
+
+//Heading [degrees] of the synthesized robot at the end of the last chunk read, positive clockwise
+float audio_source_heading(const audio_source_t *src);
+
+//Step counters of the motors at the end of the last chunk read, following motor_rate and spin, also for recordings
+void audio_source_steps(const audio_source_t *src, int32_t *left, int32_t *right);
+
+void audio_source_close(audio_source_t *src);
+
+//Parses the synthesizer/recording options shared by the harnesses, returns the number of
+//arguments consumed (0 if argv[0] is not a source option)
+int audio_source_parse_arg(int argc, char **argv, synth_config_t *config, const char **path);
+
+//Help text of the options parsed by audio_source_parse_arg
+extern const char audio_source_usage[];
+
+#endif /* AUDIO_SOURCE_H */
@@ -0,0 +1,144 @@
+/*
+
+File    : bench_atan2.c
+
+Accuracy and speed check of atan2_approx against atan2f. The error is measured against a
+double precision atan2 on points covering every octant, the axes, the origin and radii from
+1e-3 to 1e5 (the scale of the spectra). The speed is measured on blocks of 8 points, the
+size used by the phase extraction of audio_processing.c.
+
+Output : one CSV line per function on stdout. The exit status is 1 if atan2_approx exceeds
+ATAN2_MAX_ERROR or is not faster than atan2f.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ch.h"
+#include <fft.h>
+
+#include "bench_util.h"
+
+#define ATAN2_MAX_ERROR		4e-6	//[rad] Accuracy pinned for atan2_approx
+#define NB_POINTS			200000	//Points of the accuracy test
+#define BLOCK				8		//Points per call in the speed test
+#define NB_BLOCKS			1024	//Different blocks cycled through by the speed test
+#define MIN_TIME_NS			200000000ULL	//Duration of each speed measurement
+
+typedef void (*atan2_func_t)(const float* y, const float* x, float* angle, uint16_t n);
+
+//Reference : the libm function called on each point
+static void atan2_libm(const float* y, const float* x, float* angle, uint16_t n)
+{
+	for(uint16_t i = 0 ; i < n ; i++)
+	{
+		angle[i] = atan2f(y[i], x[i]);
+	}
+}
+
+//xorshift32 generator, deterministic across platforms
+static uint32_t next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+//Fills the points : a few special ones, then random angles and log-uniform radii
+static void make_points(float* y, float* x, uint32_t n)
+{
+	static const float special[][2] = {
+		{0, 0}, {0, 1}, {1, 0}, {0, -1}, {-1, 0}, {1, 1}, {-1, 1}, {1, -1}, {-1, -1},
+		{-0.0f, -1}, {1e-3f, -1e5f}, {-1e-3f, -1e5f},
+	};
+	uint32_t rng = 1;
+	uint32_t nb_special = sizeof(special) / sizeof(special[0]);
+
+	for(uint32_t i = 0 ; i < n ; i++)
+	{
+		if(i < nb_special)
+		{
+			y[i] = special[i][0];
+			x[i] = special[i][1];
+			continue;
+		}
+		double angle = 2.0 * M_PI * (next_random(&rng) / 4294967296.0) - M_PI;
+		double radius = pow(10.0, -3.0 + 8.0 * (next_random(&rng) / 4294967296.0));
+		y[i] = (float)(radius * sin(angle));
+		x[i] = (float)(radius * cos(angle));
+	}
+}
+
+//Largest error against the double precision atan2, the difference is wrapped so that -PI and PI agree
+static double max_error(atan2_func_t func, const float* y, const float* x, uint32_t n)
+{
+	float angle[BLOCK];
+	double worst = 0;
+
+	for(uint32_t i = 0 ; i < n ; i += BLOCK)
+	{
+		uint16_t nb = (n - i < BLOCK) ? n - i : BLOCK;
+		func(&y[i], &x[i], angle, nb);
+		for(uint16_t k = 0 ; k < nb ; k++)
+		{
+			double err = fabs(remainder(angle[k] - atan2((double)y[i+k], (double)x[i+k]), 2.0 * M_PI));
+			if(err > worst){worst = err;}
+		}
+	}
+	return worst;
+}
+
+//Time per point [ns], best of three measurements
+static double time_per_point(atan2_func_t func, const float* y, const float* x)
+{
+	static float angle[BLOCK];
+	double best = 0;
+
+	for(uint8_t run = 0 ; run < 3 ; run++)
+	{
+		uint64_t calls = 0, start = bench_now_ns(), elapsed;
+		do
+		{
+			for(uint32_t b = 0 ; b < NB_BLOCKS ; b++)
+			{
+				func(&y[b * BLOCK], &x[b * BLOCK], angle, BLOCK);
+				//Keeps the compiler from removing the calls
+				__asm__ volatile("" : : "r"(angle) : "memory");
+			}
+			calls += NB_BLOCKS;
+			elapsed = bench_now_ns() - start;
+		}while(elapsed < MIN_TIME_NS);
+
+		double ns = (double)elapsed / (calls * BLOCK);
+		if(run == 0 || ns < best){best = ns;}
+	}
+	return best;
+}
+
+
+int main(void)
+{
+	float *y = malloc(NB_POINTS * sizeof(float));
+	float *x = malloc(NB_POINTS * sizeof(float));
+	if(y == NULL || x == NULL){return 2;}
+	make_points(y, x, NB_POINTS);
+
+	double err_libm = max_error(atan2_libm, y, x, NB_POINTS);
+	double err_approx = max_error(atan2_approx, y, x, NB_POINTS);
+	double ns_libm = time_per_point(atan2_libm, y, x);
+	double ns_approx = time_per_point(atan2_approx, y, x);
+	int pass = (err_approx <= ATAN2_MAX_ERROR) && (ns_approx < ns_libm);
+
+	printf("function,max_abs_err_rad,ns_per_point,speedup,result\n");
+	printf("atan2f,%.3g,%.2f,1.00,reference\n", err_libm, ns_libm);
+	printf("atan2_approx,%.3g,%.2f,%.2f,%s\n", err_approx, ns_approx, ns_libm / ns_approx, pass ? "pass" : "fail");
+
+	free(y);
+	free(x);
+	return pass ? 0 : 1;
+}
@@ -0,0 +1,351 @@
+/*
+
+File    : bench_audio.c
+
+Replay benchmark for processAudioData. Feeds recorded (or synthesized) 10ms chunks of
+interleaved [right, left, back, front] samples to the microphone callback and reports
+the per-call latency, the processing time of each frame by the DSP thread and the
+angle/status trajectory returned by get_angle/get_audio_status, with the SNR of the beacon and
+the length of the frames, which follows this SNR unless -n fixes it.
+
+By default the harness waits for the DSP thread after every completed frame, so that the
+results do not depend on the host scheduling. With -r the chunks are fed at the real
+10ms cadence instead and the overrun counter shows whether the DSP thread keeps up.
+
+Output : one CSV summary line on stdout, and optionally the per-call trajectory as CSV.
+With a synthesized source, settle_ms is the time after which get_angle stays within
+SETTLE_TOLERANCE of the synthesized bearing (-1 if it never does, or for recordings). With --spin
+and --motor the step counters of the motors follow the motion of the robot, and the speed of the
+wheels is given to set_audio_motor_speed like pathing.c does.
+load_us_per_s adds the time spent in the callback and in the DSP thread per second of audio, it
+compares configurations that split the work differently (e.g. AUDIO_DECIMATION).
+With -d chirp or -d pn the coded beacon given by --code is detected by the matched filter, the frame_xxx
+timings give its cost per frame.
+With --calibrate the offsets of the microphones are measured against the synthesized beacons during the
+first seconds and saved to the flash, which -m keeps in a file from one run to the next.
+With --check the exit status is 1 if the synthesized run never settles, make host-check uses it.
+No recording of the robot comes with the harness : the files written with -w hold the synthesized
+source, so the figures of the synthesized runs and of their replays are a synthetic evaluation only.
+Recordings made on the robot with the same layout can be replayed with -i.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ch.h"
+#include "hal.h"
+#include <audio_processing.h>
+#include <motors.h>
+#include <flash/flash.h>
+
+#include "audio_source.h"
+#include "bench_util.h"
+
+#define SETTLE_TOLERANCE	15.0f	//[deg] Angle error below which the estimate is considered settled, MAX_ANGLE_ERROR of pathing.c
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [options]\n%s"
+			"  -e NAME        spectral estimator : fft (default) or goertzel\n"
+			"  -b NAME        bearing estimator : phase (default), gcc or srp\n"
+			"  -d NAME        detection : tone (default), chirp or pn\n"
+			"  -r             feed the chunks in real time instead of waiting for the DSP thread\n"
+			"  -t FILE        write the per-call trajectory as CSV\n"
+			"  -w FILE        write the replayed chunks as a recording\n"
+			"  -f HZ[,HZ...]  beacons tracked with set_audio_beacons, the first one is reported by get_angle\n"
+			"  -n N           frame length fixed with set_audio_frame_length, 0 follows the SNR (default)\n"
+			"  --calibrate S  calibrates the microphones at the synthesized bearing during the first S seconds\n"
+			"  -m FILE        flash configuration sector, loaded before the run if the file exists and saved after it\n"
+			"  --check        exit status 1 if the synthesized run never settles\n",
+			prog, audio_source_usage);
+}
+
+
+int main(int argc, char **argv)
+{
+	synth_config_t synth;
+	const char *in_path = NULL, *traj_path = NULL, *rec_path = NULL, *flash_path = NULL, *estimator = "fft", *bearing = "phase", *detection = "tone";
+	uint16_t beacon_hz[AUDIO_MAX_BEACONS];
+	uint8_t nb_beacons = 0;
+	audio_source_t src;
+	FILE *traj = NULL, *rec = NULL;
+	bool realtime = FALSE;
+	bool check = FALSE;
+	uint16_t frame_length = 0;
+	uint32_t calibrate_chunks = 0;
+
+	audio_source_default_synth(&synth);
+	for(int i = 1 ; i < argc ; )
+	{
+		int used = audio_source_parse_arg(argc - i, argv + i, &synth, &in_path);
+		if(used > 0){i += used; continue;}
+		if(i + 1 < argc && !strcmp(argv[i], "-e")){estimator = argv[i+1]; i += 2; continue;}
+		if(i + 1 < argc && !strcmp(argv[i], "-b")){bearing = argv[i+1]; i += 2; continue;}
+		if(i + 1 < argc && !strcmp(argv[i], "-d")){detection = argv[i+1]; i += 2; continue;}
+		if(!strcmp(argv[i], "-r")){realtime = TRUE; i++; continue;}
+		if(!strcmp(argv[i], "--check")){check = TRUE; i++; continue;}
+		if(i + 1 < argc && !strcmp(argv[i], "-t")){traj_path = argv[i+1]; i += 2; continue;}
+		if(i + 1 < argc && !strcmp(argv[i], "-w")){rec_path = argv[i+1]; i += 2; continue;}
+		if(i + 1 < argc && !strcmp(argv[i], "-m")){flash_path = argv[i+1]; i += 2; continue;}
+		if(i + 1 < argc && !strcmp(argv[i], "--calibrate")){calibrate_chunks = (uint32_t)(strtof(argv[i+1], NULL) * 100); i += 2; continue;}
+		if(i + 1 < argc && !strcmp(argv[i], "-n")){frame_length = (uint16_t)strtoul(argv[i+1], NULL, 10); i += 2; continue;}
+		if(i + 1 < argc && !strcmp(argv[i], "-f"))
+		{
+			char *next = argv[i+1];
+			for(nb_beacons = 0 ; nb_beacons < AUDIO_MAX_BEACONS && *next ; nb_beacons++)
+			{
+				beacon_hz[nb_beacons] = (uint16_t)strtoul(next, &next, 10);
+				if(*next == ','){next++;}
+			}
+			i += 2;
+			continue;
+		}
+		usage(argv[0]);
+		return 2;
+	}
+
+	if(!strcmp(estimator, "fft"))
+	{
+		set_audio_estimator(ESTIMATOR_FFT);
+	}
+	else if(!strcmp(estimator, "goertzel"))
+	{
+		set_audio_estimator(ESTIMATOR_GOERTZEL);
+	}
+	else
+	{
+		usage(argv[0]);
+		return 2;
+	}
+
+	if(!strcmp(bearing, "phase"))
+	{
+		set_bearing_estimator(BEARING_PHASE);
+	}
+	else if(!strcmp(bearing, "gcc"))
+	{
+		set_bearing_estimator(BEARING_GCC_PHAT);
+	}
+	else if(!strcmp(bearing, "srp"))
+	{
+		set_bearing_estimator(BEARING_SRP_PHAT);
+	}
+	else
+	{
+		usage(argv[0]);
+		return 2;
+	}
+
+	uint8_t detection_mode;
+	if(!strcmp(detection, "tone"))
+	{
+		detection_mode = DETECTION_TONE;
+	}
+	else if(!strcmp(detection, "chirp"))
+	{
+		detection_mode = DETECTION_CHIRP;
+	}
+	else if(!strcmp(detection, "pn"))
+	{
+		detection_mode = DETECTION_PN;
+	}
+	else
+	{
+		usage(argv[0]);
+		return 2;
+	}
+	if(!set_audio_detection(detection_mode))
+	{
+		fprintf(stderr, "detection %s is not built with these frame lengths (AUDIO_CODED_BEACONS)\n", detection);
+		return 2;
+	}
+
+	if(in_path)
+	{
+		if(audio_source_open_file(&src, in_path, &synth))
+		{
+			fprintf(stderr, "cannot open %s\n", in_path);
+			return 1;
+		}
+	}
+	else
+	{
+		audio_source_open_synth(&src, &synth);
+	}
+	if(traj_path && (traj = fopen(traj_path, "w")) == NULL)
+	{
+		fprintf(stderr, "cannot open %s\n", traj_path);
+		return 1;
+	}
+	if(rec_path && (rec = fopen(rec_path, "wb")) == NULL)
+	{
+		fprintf(stderr, "cannot open %s\n", rec_path);
+		return 1;
+	}
+	if(traj)
+	{
+		fprintf(traj, "chunk,t_ms,call_ns,frame,status,angle_deg,confidence,variance,age_ms,snr_db,frame_length\n");
+	}
+
+	latency_stats_t calls, frames;
+	latency_init(&calls);
+	latency_init(&frames);
+	uint32_t detected = 0, processed = 0;
+	uint64_t length_sum = 0, length_count = 0;
+	int32_t settle_ms = 0;
+	int16_t chunk[MIC_BUFFER_LEN];
+	audio_stats_t stats;
+
+	//Configuration sector of a previous run
+	FILE *flash = flash_path ? fopen(flash_path, "rb") : NULL;
+	if(flash)
+	{
+		if(fread(_config_start, 1, CONFIG_SECTOR_SIZE, flash) != CONFIG_SECTOR_SIZE)
+		{
+			fprintf(stderr, "cannot read %s\n", flash_path);
+			return 1;
+		}
+		fclose(flash);
+	}
+
+	audio_processing_start();
+	if(calibrate_chunks){start_audio_calibration(synth.angle);}
+	set_audio_motor_speed((int16_t)synth.motor_rate, (int16_t)synth.motor_rate);
+	if(!set_audio_frame_length(frame_length))
+	{
+		fprintf(stderr, "frame length not supported\n");
+		return 2;
+	}
+	if(nb_beacons && !set_audio_beacons(beacon_hz, nb_beacons))
+	{
+		fprintf(stderr, "beacons outside the analyzed band or too close to each other\n");
+		return 2;
+	}
+	uint64_t t0 = bench_now_ns();
+
+	while(audio_source_read(&src, chunk))
+	{
+		if(rec)
+		{
+			uint8_t raw[2 * MIC_BUFFER_LEN];
+			for(uint16_t i = 0 ; i < MIC_BUFFER_LEN ; i++)
+			{
+				raw[2*i] = (uint8_t)chunk[i];
+				raw[2*i+1] = (uint8_t)((uint16_t)chunk[i] >> 8);
+			}
+			fwrite(raw, sizeof(raw), 1, rec);
+		}
+
+		if(realtime)
+		{
+			//Waits for the time at which the microphones would deliver this chunk
+			uint64_t due = t0 + (uint64_t)(src.chunk - 1) * 10000000ULL;
+			while(bench_now_ns() < due)
+			{
+				chThdSleepMilliseconds(1);
+			}
+		}
+
+		//Step counters when the chunk is delivered
+		int32_t left, right;
+		audio_source_steps(&src, &left, &right);
+		left_motor_set_pos(left);
+		right_motor_set_pos(right);
+
+		uint64_t start = bench_now_ns();
+		processAudioData(chunk, MIC_BUFFER_LEN);
+		latency_add(&calls, bench_now_ns() - start);
+
+		if(calibrate_chunks && src.chunk == calibrate_chunks && !save_audio_calibration())
+		{
+			fprintf(stderr, "calibration failed, no beacon detected in the band or the flash sector holds other data\n");
+			return 1;
+		}
+
+		//Lockstep : waits until the DSP thread has handled every completed frame
+		get_audio_stats(&stats);
+		while(!realtime && stats.processed + stats.overruns < stats.frames)
+		{
+			chThdSleepMilliseconds(0);
+			get_audio_stats(&stats);
+		}
+		if(stats.processed != processed)
+		{
+			processed = stats.processed;
+			latency_add(&frames, stats.last_frame_rtc * (1000000000ULL / STM32_SYSCLK));
+			if(get_audio_status() == AUDIO_DETECTED){detected++;}
+			audio_snapshot_t snap;
+			get_audio_snapshot(&snap);
+			length_sum += snap.frame_length;
+			length_count++;
+		}
+		//The estimate is not settled as long as it leaves the tolerance
+		float error = fabsf(remainderf(get_angle() - synth.angle + audio_source_heading(&src), 360.0f));
+		if(get_audio_status() != AUDIO_DETECTED || error > SETTLE_TOLERANCE)
+		{
+			settle_ms = src.chunk * 10;
+		}
+		if(traj)
+		{
+			audio_snapshot_t snap;
+			get_audio_snapshot(&snap);
+			fprintf(traj, "%u,%u,%llu,%u,%u,%.3f,%.3f,%.2f,%u,%.1f,%u\n", src.chunk - 1, (src.chunk - 1) * 10,
+					(unsigned long long)calls.samples[calls.count - 1], snap.frame, snap.status,
+					snap.status ? snap.angle : 0, snap.confidence, snap.variance, snap.age_ms, snap.snr_db, snap.frame_length);
+		}
+	}
+
+	//Lets the DSP thread finish the last frame
+	do
+	{
+		chThdSleepMilliseconds(1);
+		get_audio_stats(&stats);
+	}while(stats.processed + stats.overruns < stats.frames);
+
+	//Summary
+	if(in_path || settle_ms >= (int32_t)src.chunk * 10){settle_ms = -1;}
+	printf("source,estimator,bearing,detection,");
+	latency_print_header(stdout, "call");
+	printf(",");
+	latency_print_header(stdout, "frame");
+	printf(",overruns,detected_frames,final_status,final_angle_deg,load_us_per_s,settle_ms,source_hz,mean_frame_length,calibrated,beacons\n");
+	printf("%s,%s,%s,%s,", in_path ? in_path : "synth", estimator, bearing, detection);
+	latency_print_values(stdout, &calls);
+	printf(",");
+	latency_print_values(stdout, &frames);
+	//Callback and DSP thread time per second of audio
+	double load = (calls.sum + frames.sum) / 1000.0 / (calls.count * 0.01);
+	printf(",%u,%u,%u,%.3f,%.1f,%d,%.2f,%.0f,%u,", stats.overruns, detected, get_audio_status(), get_angle(), load, settle_ms,
+			get_source_frequency(), length_count ? (double)length_sum / length_count : 0.0, is_audio_calibrated());
+	//Final status and angle of each beacon given with -f, as HZ:STATUS:ANGLE separated by semicolons
+	for(uint8_t b = 0 ; b < nb_beacons ; b++)
+	{
+		audio_snapshot_t snap;
+		get_beacon_snapshot(b, &snap);
+		printf("%s%u:%u:%.3f", b ? ";" : "", beacon_hz[b], snap.status, snap.angle);
+	}
+	printf("\n");
+
+	latency_free(&calls);
+	latency_free(&frames);
+	audio_source_close(&src);
+	if(traj){fclose(traj);}
+	if(rec){fclose(rec);}
+	if(flash_path)
+	{
+		if((flash = fopen(flash_path, "wb")) == NULL || fwrite(_config_start, 1, CONFIG_SECTOR_SIZE, flash) != CONFIG_SECTOR_SIZE)
+		{
+			fprintf(stderr, "cannot write %s\n", flash_path);
+			return 1;
+		}
+		fclose(flash);
+	}
+	if(check && settle_ms < 0)
+	{
+		fprintf(stderr, "the estimate never settled within %.0f deg of the synthesized bearing\n", SETTLE_TOLERANCE);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,288 @@
+/*
+
+File    : bench_fft.c
+
+Micro-benchmark of the FFT functions of fft.c. For every variant and every power of two size
+in the range, reports the time per transform, the throughput and the maximum and RMS errors
+against a direct DFT computed in double precision, as CSV on stdout.
+
+Variants :
+	cfft		doFFT_optimized, complex input
+	cfft_q15	doFFT_q15, complex input quantized to Q15, the output is scaled back up by size
+			(on the host the arm_cfft_q15 of arm_math_stub.c is measured, not the CMSIS one)
+	rfft		doRFFT_optimized, real input, bins 0 to size/2
+	fft_c		doFFT_c, complex input
+	ifft_c		doIFFT_c, compared to the input the spectrum was computed from
+	goertzel	doGoertzel on GOERTZEL_BENCH_BINS consecutive bins, real input
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ch.h"
+#include "hal.h"
+#include <fft.h>
+
+#include "bench_util.h"
+
+#define GOERTZEL_BENCH_BINS		11		//Width of the band analyzed by audio_processing
+
+typedef enum {
+	VARIANT_CFFT,
+	VARIANT_CFFT_Q15,
+	VARIANT_RFFT,
+	VARIANT_FFT_C,
+	VARIANT_IFFT_C,
+	VARIANT_GOERTZEL,
+	NB_VARIANTS,
+} variant_t;
+
+static const char *variant_names[NB_VARIANTS] = {"cfft", "cfft_q15", "rfft", "fft_c", "ifft_c", "goertzel"};
+
+//Test signal and its double precision DFT
+static float signal[2 * FFT_MAX_SIZE];
+static double reference[2 * FFT_MAX_SIZE];
+//Working buffers
+static float work[2 * FFT_MAX_SIZE];
+static float output[2 * FFT_MAX_SIZE];
+static q15_t work_q15[2 * FFT_MAX_SIZE];
+static uint16_t goertzel_bins[GOERTZEL_BENCH_BINS];
+
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [options]\n"
+			"  --min N        smallest size (default 64)\n"
+			"  --max N        largest size (default 4096)\n"
+			"  --time MS      minimum measurement time per point (default 100)\n"
+			"  --variant NAME only this variant (cfft, cfft_q15, rfft, fft_c, ifft_c, goertzel)\n", prog);
+}
+
+
+//Random test signal in [-1, 1], the imaginary parts are zero for a real signal
+static void make_signal(uint16_t size, bool real)
+{
+	uint32_t state = 12345;
+	for(uint16_t i = 0 ; i < 2 * size ; i++)
+	{
+		state = state * 1664525U + 1013904223U;
+		signal[i] = (i & 1) && real ? 0 : (float)((int32_t)state / 2147483648.0);
+	}
+}
+
+
+//Direct DFT in double precision with the e^-j convention
+static void reference_dft(uint16_t size)
+{
+	double *cosine = malloc(size * sizeof(double));
+	double *sine = malloc(size * sizeof(double));
+	if(cosine == NULL || sine == NULL){abort();}
+
+	for(uint16_t i = 0 ; i < size ; i++)
+	{
+		cosine[i] = cos(2.0 * M_PI * i / size);
+		sine[i] = sin(2.0 * M_PI * i / size);
+	}
+	for(uint32_t k = 0 ; k < size ; k++)
+	{
+		double re = 0, im = 0;
+		for(uint32_t n = 0 ; n < size ; n++)
+		{
+			uint32_t idx = (k * n) % size;
+			re += signal[2*n] * cosine[idx] + signal[2*n+1] * sine[idx];
+			im += signal[2*n+1] * cosine[idx] - signal[2*n] * sine[idx];
+		}
+		reference[2*k] = re;
+		reference[2*k+1] = im;
+	}
+	free(cosine);
+	free(sine);
+}
+
+
+//Prepares the input of a variant in work
+static void load_input(variant_t variant, uint16_t size)
+{
+	switch(variant)
+	{
+		case VARIANT_RFFT:
+		case VARIANT_GOERTZEL:
+			for(uint16_t i = 0 ; i < size ; i++){work[i] = signal[2*i];}
+			break;
+		case VARIANT_IFFT_C:
+			for(uint16_t i = 0 ; i < 2 * size ; i++){work[i] = (float)reference[i];}
+			break;
+		case VARIANT_CFFT_Q15:
+			for(uint16_t i = 0 ; i < 2 * size ; i++){work_q15[i] = (q15_t)lrintf(signal[i] * 32767.0f);}
+			break;
+		default:
+			memcpy(work, signal, 2 * size * sizeof(float));
+			break;
+	}
+}
+
+
+static void run(variant_t variant, uint16_t size)
+{
+	switch(variant)
+	{
+		case VARIANT_CFFT:		doFFT_optimized(size, work); break;
+		case VARIANT_CFFT_Q15:	doFFT_q15(size, work_q15); break;
+		case VARIANT_RFFT:		doRFFT_optimized(size, work, output); break;
+		case VARIANT_FFT_C:		doFFT_c(size, (complex_float *)work); break;
+		case VARIANT_IFFT_C:	doIFFT_c(size, (complex_float *)work); break;
+		case VARIANT_GOERTZEL:	doGoertzel(size, work, 1, goertzel_bins, GOERTZEL_BENCH_BINS, output); break;
+		default: break;
+	}
+}
+
+
+//Compares the result of a variant to the reference, returns the maximum and RMS errors
+static void measure_error(variant_t variant, uint16_t size, double *max_err, double *rms_err, double *rms_ref)
+{
+	double sum_err = 0, sum_ref = 0;
+	uint16_t nb = 0;
+	*max_err = 0;
+
+	for(uint16_t k = 0 ; k < size ; k++)
+	{
+		double re, im, ref_re, ref_im;
+		switch(variant)
+		{
+			case VARIANT_RFFT:
+				//Bins 1 to size/2-1, bin 0 and size/2 are packed in the first value
+				if(k >= size / 2){continue;}
+				re = (k == 0) ? output[0] : output[2*k];
+				im = (k == 0) ? 0 : output[2*k+1];
+				break;
+			case VARIANT_GOERTZEL:
+				if(k >= GOERTZEL_BENCH_BINS){continue;}
+				re = output[2*k];
+				im = output[2*k+1];
+				break;
+			case VARIANT_CFFT_Q15:
+				//Q15 scaled down by size
+				re = work_q15[2*k] * (double)size / 32768.0;
+				im = work_q15[2*k+1] * (double)size / 32768.0;
+				break;
+			default:
+				re = work[2*k];
+				im = work[2*k+1];
+				break;
+		}
+		if(variant == VARIANT_IFFT_C)
+		{
+			ref_re = signal[2*k];
+			ref_im = signal[2*k+1];
+		}
+		else
+		{
+			uint16_t bin = (variant == VARIANT_GOERTZEL) ? goertzel_bins[k] : k;
+			ref_re = reference[2*bin];
+			ref_im = reference[2*bin+1];
+		}
+		double err = hypot(re - ref_re, im - ref_im);
+		if(err > *max_err){*max_err = err;}
+		sum_err += err * err;
+		sum_ref += ref_re * ref_re + ref_im * ref_im;
+		nb++;
+	}
+	*rms_err = sqrt(sum_err / nb);
+	*rms_ref = sqrt(sum_ref / nb);
+}
+
+
+//Mean time [ns] of one call to run, the time to reload the input is measured apart and removed
+static double measure_time(variant_t variant, uint16_t size, double min_ms)
+{
+	uint32_t iterations = 1;
+	double total, copy;
+
+	while(1)
+	{
+		uint64_t start = bench_now_ns();
+		for(uint32_t i = 0 ; i < iterations ; i++)
+		{
+			load_input(variant, size);
+			run(variant, size);
+		}
+		total = (double)(bench_now_ns() - start);
+		if(total >= min_ms * 1e6){break;}
+		iterations *= 2;
+	}
+
+	uint64_t start = bench_now_ns();
+	for(uint32_t i = 0 ; i < iterations ; i++)
+	{
+		load_input(variant, size);
+		__asm__ volatile("" ::: "memory");
+	}
+	copy = (double)(bench_now_ns() - start);
+
+	return (total - copy) / iterations;
+}
+
+
+int main(int argc, char **argv)
+{
+	uint16_t min_size = 64, max_size = FFT_MAX_SIZE;
+	double min_ms = 100;
+	int only = -1;
+
+	for(int i = 1 ; i < argc ; i += 2)
+	{
+		if(i + 1 >= argc){usage(argv[0]); return 2;}
+		if(!strcmp(argv[i], "--min")){min_size = (uint16_t)atoi(argv[i+1]);}
+		else if(!strcmp(argv[i], "--max")){max_size = (uint16_t)atoi(argv[i+1]);}
+		else if(!strcmp(argv[i], "--time")){min_ms = atof(argv[i+1]);}
+		else if(!strcmp(argv[i], "--variant"))
+		{
+			for(int v = 0 ; v < NB_VARIANTS ; v++)
+			{
+				if(!strcmp(argv[i+1], variant_names[v])){only = v;}
+			}
+			if(only < 0){usage(argv[0]); return 2;}
+		}
+		else{usage(argv[0]); return 2;}
+	}
+	if(min_size < FFT_MIN_SIZE || max_size > FFT_MAX_SIZE || min_size > max_size)
+	{
+		fprintf(stderr, "sizes must be within %d..%d\n", FFT_MIN_SIZE, FFT_MAX_SIZE);
+		return 2;
+	}
+
+	printf("variant,size,ns_per_transform,transforms_per_s,max_abs_err,rms_err,rel_rms_err\n");
+	for(uint32_t size = min_size ; size <= max_size ; size *= 2)
+	{
+		//Goertzel band centered on size/16 (the beacon bin at 1024 points) when the size allows it
+		uint16_t first_bin = (size / 16 > GOERTZEL_BENCH_BINS / 2) ? size / 16 - GOERTZEL_BENCH_BINS / 2 : 1;
+		for(uint16_t b = 0 ; b < GOERTZEL_BENCH_BINS ; b++)
+		{
+			goertzel_bins[b] = first_bin + b;
+		}
+
+		for(int v = 0 ; v < NB_VARIANTS ; v++)
+		{
+			double max_err, rms_err, rms_ref;
+			bool real = (v == VARIANT_RFFT || v == VARIANT_GOERTZEL);
+
+			if(only >= 0 && v != only){continue;}
+			//The real variants only need at least 2 * FFT_MIN_SIZE points
+			if(v == VARIANT_RFFT && size < 2 * FFT_MIN_SIZE){continue;}
+
+			make_signal(size, real);
+			reference_dft(size);
+			load_input(v, size);
+			run(v, size);
+			measure_error(v, size, &max_err, &rms_err, &rms_ref);
+			double ns = measure_time(v, size, min_ms);
+
+			printf("%s,%u,%.1f,%.0f,%.3e,%.3e,%.3e\n", variant_names[v], size, ns, 1e9 / ns,
+					max_err, rms_err, rms_err / rms_ref);
+			fflush(stdout);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,91 @@
+/*
+
+File    : bench_util.c
+
+Timing and statistics helpers shared by the host benchmarks
+*/
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "bench_util.h"
+
+
+uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+void latency_init(latency_stats_t *stats)
+{
+	stats->samples = NULL;
+	stats->count = 0;
+	stats->capacity = 0;
+	stats->sum = 0;
+}
+
+
+void latency_add(latency_stats_t *stats, uint64_t ns)
+{
+	if(stats->count == stats->capacity)
+	{
+		stats->capacity = stats->capacity ? 2 * stats->capacity : 1024;
+		stats->samples = realloc(stats->samples, stats->capacity * sizeof(uint64_t));
+		if(stats->samples == NULL){abort();}
+	}
+	stats->samples[stats->count++] = ns;
+	stats->sum += ns;
+}
+
+
+void latency_free(latency_stats_t *stats)
+{
+	free(stats->samples);
+	latency_init(stats);
+}
+
+
+double latency_mean(const latency_stats_t *stats)
+{
+	return stats->count ? (double)stats->sum / stats->count : 0;
+}
+
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+
+uint64_t latency_percentile(latency_stats_t *stats, double p)
+{
+	if(stats->count == 0){return 0;}
+	qsort(stats->samples, stats->count, sizeof(uint64_t), compare_u64);
+	uint32_t index = (uint32_t)(p / 100.0 * (stats->count - 1) + 0.5);
+	return stats->samples[index];
+}
+
+
+uint64_t latency_max(latency_stats_t *stats)
+{
+	return latency_percentile(stats, 100);
+}
+
+
+void latency_print_header(FILE *out, const char *prefix)
+{
+	fprintf(out, "%s_n,%s_mean_ns,%s_p50_ns,%s_p99_ns,%s_max_ns", prefix, prefix, prefix, prefix, prefix);
+}
+
+
+void latency_print_values(FILE *out, latency_stats_t *stats)
+{
+	fprintf(out, "%u,%.0f,%llu,%llu,%llu", stats->count, latency_mean(stats),
+			(unsigned long long)latency_percentile(stats, 50),
+			(unsigned long long)latency_percentile(stats, 99),
+			(unsigned long long)latency_max(stats));
+}
@@ -0,0 +1,39 @@
+/*
+
+File    : bench_util.h
+
+Timing and statistics helpers shared by the host benchmarks
+*/
+
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+//Collected latencies [ns]
+typedef struct {
+	uint64_t *samples;
+	uint32_t count;
+	uint32_t capacity;
+	uint64_t sum;
+} latency_stats_t;
+
+//Monotonic clock [ns]
+uint64_t bench_now_ns(void);
+
+void latency_init(latency_stats_t *stats);
+void latency_add(latency_stats_t *stats, uint64_t ns);
+void latency_free(latency_stats_t *stats);
+
+double latency_mean(const latency_stats_t *stats);
+//Returns the p-th percentile (0 to 100), 0 if no sample was added
+uint64_t latency_percentile(latency_stats_t *stats, double p);
+uint64_t latency_max(latency_stats_t *stats);
+
+//Writes the "<prefix>_n,<prefix>_mean_ns,<prefix>_p50_ns,<prefix>_p99_ns,<prefix>_max_ns" CSV header
+void latency_print_header(FILE *out, const char *prefix);
+//Writes the matching CSV values
+void latency_print_values(FILE *out, latency_stats_t *stats);
+
+#endif /* BENCH_UTIL_H */
@@ -0,0 +1,376 @@
+/*
+
+File    : bench_vision.c
+
+Replay benchmark for the image processing of process_image.c. Feeds recorded (or synthesized)
+RGB565 captures, the buffers of CAPTURE_WIDTH x CAPTURE_LINES pixels configured by its capture
+thread, through dcmi_get_last_image_ptr to process_last_image, which extracts the red channel
+and runs extract_lines, extract_edges, build_gate and build_goal. Reports the processing time
+per frame and the number of frames where each kind of object was seen.
+
+The objects registered for each frame (current_lines and current_obstacles) can be written as
+CSV with -o and compared with such a golden file with -g : the run fails if any frame differs.
+Only the lines that exist are compared, the fields of the others are written as 0.
+
+Synthesized captures : a green floor (red channel above the edge thresholds) with white lines
+of LINE_WIDTH pixels and dark walls, cycling through the scenes seen by the robot or showing
+only the one given by --scene, at positions drawn from the seed. The noise is computed with
+integers so that the golden files do not depend on the host.
+
+vision_golden.csv was written by this harness with -o from the default synthesized captures, with
+process_image.c as it was then : it pins the current output against regressions, it does not check
+the vision against the camera. No capture of the robot comes with the harness, the ones made with
+the same RGB565 layout can be replayed with -i and pinned in a golden file of their own.
+
+Output : one CSV summary line on stdout. The exit status is 1 if a frame differs from the golden file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include <camera/po8030.h>
+#include <process_image.h>
+
+#include "bench_util.h"
+
+#define CAPTURE_WIDTH		640		//IMAGE_BUFFER_SIZE of process_image.c
+#define CAPTURE_LINES		2		//Lines of each capture, only the first one is processed
+#define CAPTURE_BYTES		(CAPTURE_WIDTH * CAPTURE_LINES * 2)
+
+#define LINE_WIDTH			60		//[pixels] Width of the synthesized white lines
+#define EDGE_RAMP			3		//[pixels] Blur of the synthesized transitions, below WIDTH_SLOPE
+#define MAX_REGIONS			7		//Regions of one color in a synthesized capture
+
+//Scenes of the synthesized captures, from left to right
+typedef enum {
+	SCENE_EMPTY,		//Floor only
+	SCENE_LINE,			//Floor, line, floor
+	SCENE_LEFT,			//Floor, line, wall : left edge
+	SCENE_RIGHT,		//Wall, line, floor : right edge
+	SCENE_GATE,			//Wall, line, floor, line, wall : right edge then left edge
+	SCENE_GOAL,			//Three lines on the floor
+	NB_SCENES,
+} scene_t;
+
+static const char *scene_names[NB_SCENES] = {"empty", "line", "left", "right", "gate", "goal"};
+
+//Colors of the synthesized track (r, g, b)
+static const uint8_t color_floor[3] = {96, 176, 80};
+static const uint8_t color_line[3] = {224, 224, 224};
+static const uint8_t color_wall[3] = {24, 24, 24};
+
+typedef struct {
+	uint32_t rng;
+	int scene;				//Scene of every frame, -1 to cycle through all of them
+	uint16_t noise;			//Standard deviation of the noise of each color
+} vision_synth_t;
+
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [options]\n"
+			"  -i FILE        replay a recording (raw RGB565 captures of %u x %u pixels)\n"
+			"  --scene NAME   synthesized scene : all (default), empty, line, left, right, gate or goal\n"
+			"  --frames N     synthesized captures (default 600)\n"
+			"  --noise SIGMA  noise of the synthesized colors (default 6)\n"
+			"  --seed N       noise generator seed (default 1)\n"
+			"  --repeat N     times each capture is processed for the timing (default 20)\n"
+			"  -w FILE        write the replayed captures as a recording\n"
+			"  -o FILE        write the objects of each frame as CSV\n"
+			"  -g FILE        compare the objects of each frame with a file written by -o\n",
+			prog, CAPTURE_WIDTH, CAPTURE_LINES);
+}
+
+
+static uint32_t next_rand(uint32_t *state)
+{
+	//xorshift32
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+
+//Approximately normal noise of standard deviation sigma, the sum of 12 uniform values
+static int32_t noise_sample(vision_synth_t *synth)
+{
+	int32_t sum = 0;
+	for(uint8_t k = 0 ; k < 12 ; k++)
+	{
+		sum += (int32_t)(next_rand(&synth->rng) & 0xFFFF);
+	}
+	return (int32_t)(((int64_t)(sum - 6 * 0xFFFF) * synth->noise) / 0xFFFF);
+}
+
+
+static uint8_t clamp_color(int32_t value)
+{
+	return value < 0 ? 0 : (value > 255 ? 255 : (uint8_t)value);
+}
+
+
+//Writes the pixel of color (r, g, b) in RGB565, first byte RRRRRGGG as read by process_image.c
+static void put_pixel(uint8_t *pixel, uint8_t r, uint8_t g, uint8_t b)
+{
+	uint16_t value = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+	pixel[0] = value >> 8;
+	pixel[1] = value & 0xFF;
+}
+
+
+//Adds to the scene a region of the color, up to the column end
+static void add_region(const uint8_t **regions, uint16_t *bounds, uint8_t *nb, const uint8_t *color, uint16_t end)
+{
+	regions[*nb] = color;
+	bounds[*nb] = end;
+	(*nb)++;
+}
+
+
+//Synthesizes the next capture of the scene
+static void synth_capture(vision_synth_t *synth, scene_t scene, uint8_t *capture)
+{
+	static uint8_t column[CAPTURE_WIDTH][3];
+	const uint8_t *regions[MAX_REGIONS];
+	uint16_t bounds[MAX_REGIONS];
+	uint8_t nb = 0;
+	//Left side of the first line
+	uint16_t x = 40 + next_rand(&synth->rng) % 120;
+
+	switch(scene)
+	{
+		case SCENE_LINE:
+		case SCENE_LEFT:
+			x += next_rand(&synth->rng) % 200;
+			add_region(regions, bounds, &nb, color_floor, x);
+			add_region(regions, bounds, &nb, color_line, x + LINE_WIDTH);
+			add_region(regions, bounds, &nb, scene == SCENE_LEFT ? color_wall : color_floor, CAPTURE_WIDTH);
+			break;
+		case SCENE_RIGHT:
+			x += next_rand(&synth->rng) % 200;
+			add_region(regions, bounds, &nb, color_wall, x);
+			add_region(regions, bounds, &nb, color_line, x + LINE_WIDTH);
+			add_region(regions, bounds, &nb, color_floor, CAPTURE_WIDTH);
+			break;
+		case SCENE_GATE:
+			add_region(regions, bounds, &nb, color_wall, x);
+			add_region(regions, bounds, &nb, color_line, x + LINE_WIDTH);
+			x += 2 * LINE_WIDTH + 20 + next_rand(&synth->rng) % 120;
+			add_region(regions, bounds, &nb, color_floor, x);
+			add_region(regions, bounds, &nb, color_line, x + LINE_WIDTH);
+			add_region(regions, bounds, &nb, color_wall, CAPTURE_WIDTH);
+			break;
+		case SCENE_GOAL:
+			//Gaps between the lines about as wide as the lines
+			for(uint8_t l = 0 ; l < 3 ; l++)
+			{
+				add_region(regions, bounds, &nb, color_floor, x);
+				add_region(regions, bounds, &nb, color_line, x + LINE_WIDTH);
+				x += 2 * LINE_WIDTH + next_rand(&synth->rng) % 20;
+			}
+			add_region(regions, bounds, &nb, color_floor, CAPTURE_WIDTH);
+			break;
+		default:
+			add_region(regions, bounds, &nb, color_floor, CAPTURE_WIDTH);
+			break;
+	}
+
+	for(uint16_t k = 0, r = 0 ; k < CAPTURE_WIDTH ; k++)
+	{
+		while(k >= bounds[r]){r++;}
+		memcpy(column[k], regions[r], 3);
+	}
+
+	for(uint8_t line = 0 ; line < CAPTURE_LINES ; line++)
+	{
+		for(uint16_t k = 0 ; k < CAPTURE_WIDTH ; k++)
+		{
+			int32_t rgb[3];
+			for(uint8_t c = 0 ; c < 3 ; c++)
+			{
+				//Linear blur over EDGE_RAMP pixels, the colors of the lens are not sharp
+				int32_t sum = 0;
+				for(int16_t d = 0 ; d < EDGE_RAMP ; d++)
+				{
+					int16_t i = k + d - EDGE_RAMP / 2;
+					i = i < 0 ? 0 : (i >= CAPTURE_WIDTH ? CAPTURE_WIDTH - 1 : i);
+					sum += column[i][c];
+				}
+				rgb[c] = sum / EDGE_RAMP + noise_sample(synth);
+			}
+			put_pixel(&capture[2 * (line * CAPTURE_WIDTH + k)], clamp_color(rgb[0]), clamp_color(rgb[1]), clamp_color(rgb[2]));
+		}
+	}
+}
+
+
+//Writes the objects of the frame as a CSV row, without the newline
+static void format_objects(char *row, size_t size, uint32_t frame, const struct line *lines, const struct obstacle *obstacles)
+{
+	int n = snprintf(row, size, "%u", frame);
+	for(uint8_t i = 0 ; i < MAX_OBJECTS ; i++)
+	{
+		if(lines[i].exist)
+		{
+			n += snprintf(row + n, size - n, ",1,%u,%u,%u,%u", lines[i].start, lines[i].end, lines[i].pos, lines[i].meanval);
+		}
+		else
+		{
+			n += snprintf(row + n, size - n, ",0,0,0,0,0");
+		}
+	}
+	for(uint8_t i = 0 ; i < MAX_OBJECTS ; i++)
+	{
+		n += snprintf(row + n, size - n, ",%u,%u", obstacles[i].type, obstacles[i].pos);
+	}
+}
+
+
+static void print_objects_header(FILE *out)
+{
+	fprintf(out, "frame");
+	for(uint8_t i = 0 ; i < MAX_OBJECTS ; i++)
+	{
+		fprintf(out, ",line%u_exist,line%u_start,line%u_end,line%u_pos,line%u_meanval", i, i, i, i, i);
+	}
+	for(uint8_t i = 0 ; i < MAX_OBJECTS ; i++)
+	{
+		fprintf(out, ",obstacle%u_type,obstacle%u_pos", i, i);
+	}
+	fprintf(out, "\n");
+}
+
+
+int main(int argc, char **argv)
+{
+	const char *in_path = NULL, *rec_path = NULL, *out_path = NULL, *golden_path = NULL;
+	vision_synth_t synth = {.rng = 1, .scene = -1, .noise = 6};
+	uint32_t nb_frames = 600, repeat = 20;
+	FILE *in = NULL, *rec = NULL, *out = NULL, *golden = NULL;
+
+	for(int i = 1 ; i < argc ; i += 2)
+	{
+		if(i + 1 >= argc){usage(argv[0]); return 2;}
+		if(!strcmp(argv[i], "-i")){in_path = argv[i+1]; continue;}
+		if(!strcmp(argv[i], "-w")){rec_path = argv[i+1]; continue;}
+		if(!strcmp(argv[i], "-o")){out_path = argv[i+1]; continue;}
+		if(!strcmp(argv[i], "-g")){golden_path = argv[i+1]; continue;}
+		if(!strcmp(argv[i], "--frames")){nb_frames = strtoul(argv[i+1], NULL, 0); continue;}
+		if(!strcmp(argv[i], "--noise")){synth.noise = atoi(argv[i+1]); continue;}
+		if(!strcmp(argv[i], "--seed")){synth.rng = strtoul(argv[i+1], NULL, 0); continue;}
+		if(!strcmp(argv[i], "--repeat")){repeat = strtoul(argv[i+1], NULL, 0); continue;}
+		if(!strcmp(argv[i], "--scene"))
+		{
+			synth.scene = -2;
+			if(!strcmp(argv[i+1], "all")){synth.scene = -1;}
+			for(uint8_t s = 0 ; s < NB_SCENES ; s++)
+			{
+				if(!strcmp(argv[i+1], scene_names[s])){synth.scene = s;}
+			}
+			if(synth.scene == -2){usage(argv[0]); return 2;}
+			continue;
+		}
+		usage(argv[0]);
+		return 2;
+	}
+	if(synth.rng == 0){synth.rng = 1;}
+	if(repeat == 0){repeat = 1;}
+
+	if(in_path && (in = fopen(in_path, "rb")) == NULL)
+	{
+		fprintf(stderr, "cannot open %s\n", in_path);
+		return 1;
+	}
+	if(rec_path && (rec = fopen(rec_path, "wb")) == NULL)
+	{
+		fprintf(stderr, "cannot open %s\n", rec_path);
+		return 1;
+	}
+	if(out_path && (out = fopen(out_path, "w")) == NULL)
+	{
+		fprintf(stderr, "cannot open %s\n", out_path);
+		return 1;
+	}
+	char row[512], expected[512];
+	if(golden_path && ((golden = fopen(golden_path, "r")) == NULL || fgets(expected, sizeof(expected), golden) == NULL))
+	{
+		fprintf(stderr, "cannot read %s\n", golden_path);
+		return 1;
+	}
+	if(out){print_objects_header(out);}
+
+	static uint8_t capture[CAPTURE_BYTES];
+	struct line lines[MAX_OBJECTS];
+	struct obstacle obstacles[MAX_OBJECTS];
+	latency_stats_t stats;
+	uint32_t frames = 0, mismatches = 0, first_mismatch = 0;
+	uint32_t seen[UNKNOWN + 1] = {0};
+	uint32_t line_frames = 0;
+
+	latency_init(&stats);
+	dcmi_set_last_image_ptr(capture);
+	while(in ? fread(capture, 1, CAPTURE_BYTES, in) == CAPTURE_BYTES : frames < nb_frames)
+	{
+		if(!in){synth_capture(&synth, synth.scene < 0 ? (scene_t)(frames % NB_SCENES) : (scene_t)synth.scene, capture);}
+		if(rec){fwrite(capture, 1, CAPTURE_BYTES, rec);}
+
+		//The processing of a capture does not depend on the previous ones, the repetitions only average the timing
+		for(uint32_t r = 0 ; r < repeat ; r++)
+		{
+			uint64_t start = bench_now_ns();
+			process_last_image();
+			latency_add(&stats, bench_now_ns() - start);
+		}
+
+		get_image_objects(lines, obstacles);
+		line_frames += lines[0].exist;
+		seen[obstacles[0].type <= UNKNOWN ? obstacles[0].type : 0]++;
+
+		format_objects(row, sizeof(row), frames, lines, obstacles);
+		if(out){fprintf(out, "%s\n", row);}
+		if(golden)
+		{
+			if(fgets(expected, sizeof(expected), golden) == NULL){expected[0] = '\0';}
+			expected[strcspn(expected, "\r\n")] = '\0';
+			if(strcmp(row, expected))
+			{
+				if(mismatches == 0){first_mismatch = frames;}
+				mismatches++;
+			}
+		}
+		frames++;
+	}
+	//Frames missing from the run
+	if(golden)
+	{
+		while(fgets(expected, sizeof(expected), golden) != NULL){mismatches++;}
+	}
+
+	printf("source,frames,");
+	latency_print_header(stdout, "frame");
+	printf(",line_frames,left_edge_frames,right_edge_frames,gate_frames,goal_frames,golden_mismatches,first_mismatch,result\n");
+	printf("%s,%u,", in_path ? in_path : (synth.scene < 0 ? "synth" : scene_names[synth.scene]), frames);
+	latency_print_values(stdout, &stats);
+	printf(",%u,%u,%u,%u,%u,", line_frames, seen[LEFT_EDGE], seen[RIGHT_EDGE], seen[GATE], seen[GOAL]);
+	if(golden)
+	{
+		printf("%u,%d,%s\n", mismatches, mismatches ? (int)first_mismatch : -1, mismatches ? "fail" : "pass");
+	}
+	else
+	{
+		printf("0,-1,none\n");
+	}
+
+	latency_free(&stats);
+	if(in){fclose(in);}
+	if(rec){fclose(rec);}
+	if(out){fclose(out);}
+	if(golden){fclose(golden);}
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,105 @@
+/*
+
+File    : compare_traj.c
+
+Compares two trajectories written by bench_audio -t on the same source, typically the float
+and the fixed-point (AUDIO_Q15) builds, chunk by chunk. The detection decisions must agree
+on all but a fraction of the chunks and the angles, where both builds detect the beacon,
+must stay within a tolerance.
+
+Output : one CSV line on stdout. The exit status is 1 if a tolerance is exceeded.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define DEFAULT_ANGLE_TOL	2.0		//[deg] Largest accepted angle difference
+#define DEFAULT_STATUS_TOL	0.02	//Largest accepted fraction of chunks with different statuses
+
+//Reads the status and angle of the next trajectory row, returns 0 at the end of the file
+static int read_row(FILE *f, unsigned *status, double *angle)
+{
+	unsigned chunk, t_ms, frame;
+	unsigned long long call_ns;
+	char line[256];
+
+	if(fgets(line, sizeof(line), f) == NULL){return 0;}
+	return sscanf(line, "%u,%u,%llu,%u,%u,%lf", &chunk, &t_ms, &call_ns, &frame, status, angle) == 6;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [options] REFERENCE.csv TEST.csv\n"
+			"  --angle-tol DEG    largest angle difference (default %.1f)\n"
+			"  --status-tol F     largest fraction of different statuses (default %.2f)\n",
+			prog, DEFAULT_ANGLE_TOL, DEFAULT_STATUS_TOL);
+}
+
+
+int main(int argc, char **argv)
+{
+	double angle_tol = DEFAULT_ANGLE_TOL, status_tol = DEFAULT_STATUS_TOL;
+	const char *paths[2];
+	int nb_paths = 0;
+	FILE *f[2];
+	char header[256];
+
+	for(int i = 1 ; i < argc ; i++)
+	{
+		if(i + 1 < argc && !strcmp(argv[i], "--angle-tol")){angle_tol = atof(argv[++i]); continue;}
+		if(i + 1 < argc && !strcmp(argv[i], "--status-tol")){status_tol = atof(argv[++i]); continue;}
+		if(argv[i][0] == '-' || nb_paths == 2){usage(argv[0]); return 2;}
+		paths[nb_paths++] = argv[i];
+	}
+	if(nb_paths != 2){usage(argv[0]); return 2;}
+
+	for(int k = 0 ; k < 2 ; k++)
+	{
+		if((f[k] = fopen(paths[k], "r")) == NULL || fgets(header, sizeof(header), f[k]) == NULL)
+		{
+			fprintf(stderr, "cannot read %s\n", paths[k]);
+			return 2;
+		}
+	}
+
+	unsigned rows = 0, mismatches = 0, both_detected = 0;
+	double max_diff = 0, sum_diff = 0;
+	unsigned status[2];
+	double angle[2];
+
+	while(read_row(f[0], &status[0], &angle[0]) && read_row(f[1], &status[1], &angle[1]))
+	{
+		rows++;
+		if(status[0] != status[1])
+		{
+			mismatches++;
+		}
+		else if(status[0])
+		{
+			//Difference wrapped to [-180, 180]
+			double diff = fabs(remainder(angle[0] - angle[1], 360.0));
+			both_detected++;
+			sum_diff += diff;
+			if(diff > max_diff){max_diff = diff;}
+		}
+	}
+	fclose(f[0]);
+	fclose(f[1]);
+
+	if(rows == 0)
+	{
+		fprintf(stderr, "empty trajectories\n");
+		return 2;
+	}
+
+	double mismatch_ratio = (double)mismatches / rows;
+	int pass = (mismatch_ratio <= status_tol) && (max_diff <= angle_tol);
+
+	printf("rows,status_mismatches,mismatch_ratio,both_detected,mean_angle_diff_deg,max_angle_diff_deg,result\n");
+	printf("%u,%u,%.4f,%u,%.4f,%.4f,%s\n", rows, mismatches, mismatch_ratio, both_detected,
+			both_detected ? sum_diff / both_detected : 0.0, max_diff, pass ? "pass" : "fail");
+
+	return pass ? 0 : 1;
+}
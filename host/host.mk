@@ -0,0 +1,94 @@
+#Host (Linux) build of the DSP and vision modules against the stubs in ./host
+#Usage : make host       builds build_host/libprojet_host.a and the benchmarks in build_host/
+#        make host-clean removes build_host
+#Build options can be tried in a separate directory, for example
+#        make host HOST_BUILD=build_host_512 HOST_DEFS=-DAUDIO_FFT_SIZE=512
+#        make host HOST_BUILD=build_host_dec4 HOST_DEFS=-DAUDIO_DECIMATION=4
+#        make host-check      runs the benchmarks that pin an accuracy or a golden output (exit status 1 on failure)
+#        make host-compare-q15 builds the fixed-point pipeline in build_host_q15 and compares its trajectory
+#                              with the float one, on HOST_COMPARE_SRC (bench_audio source options) with
+#                              frames of HOST_COMPARE_LENGTH samples
+
+HOST_CC      ?= gcc
+HOST_BUILD   ?= build_host
+HOST_DEFS    ?=
+HOST_CFLAGS  = -std=gnu11 -O2 -g -Wall -Wextra $(HOST_DEFS)
+HOST_INCDIR  = -I./host/include -I.
+HOST_LDLIBS  = -lm -lpthread
+
+#Project modules built on the host
+HOST_CSRC    = ./audio_processing.c \
+		./fft.c \
+		./process_image.c \
+		./pathing.c \
+
+#Stand-ins for ChibiOS, the e-puck2 drivers and CMSIS-DSP
+HOST_STUBSRC = ./host/stubs/chibios_stub.c \
+		./host/stubs/hal_stub.c \
+		./host/stubs/arm_math_stub.c \
+
+#Helpers shared by the benchmarks
+HOST_BENCHSRC = ./host/bench/audio_source.c \
+		./host/bench/bench_util.c \
+
+#Benchmarks and tools, one program per file
+HOST_BENCHES = bench_audio \
+		bench_fft \
+		bench_atan2 \
+		bench_vision \
+		compare_traj \
+
+#Source replayed by host-compare-q15, for example -i recording.raw
+HOST_COMPARE_SRC ?= --angle -60 --noise 400
+#Frame length of the comparison, the float and fixed-point builds do not shorten their frames down to the same length
+HOST_COMPARE_LENGTH ?= 1024
+HOST_Q15_BUILD = $(HOST_BUILD)_q15
+#Objects found by process_image.c in the default synthesized captures of bench_vision, written with
+#bench_vision -o when a change of the vision is intended. Self-generated : it pins the output of the current code on
+#synthetic captures, not the objects of real camera images
+HOST_VISION_GOLDEN ?= ./host/bench/vision_golden.csv
+#Coded beacons checked by host-check, their carrier away from SOURCE_HZ like the one of a real beacon
+HOST_CODE_CHECK ?= --angle 60 --freq 990
+
+HOST_OBJS    = $(addprefix $(HOST_BUILD)/obj/,$(notdir $(HOST_CSRC:.c=.o) $(HOST_STUBSRC:.c=.o)))
+HOST_BENCHOBJS = $(addprefix $(HOST_BUILD)/obj/,$(notdir $(HOST_BENCHSRC:.c=.o)))
+HOST_LIB     = $(HOST_BUILD)/libprojet_host.a
+HOST_PROGS   = $(addprefix $(HOST_BUILD)/,$(HOST_BENCHES))
+
+vpath %.c . ./host/stubs ./host/bench
+
+.PHONY: host host-clean host-check host-compare-q15
+
+#Keeps the benchmark objects, make would otherwise remove them as intermediate files
+.SECONDARY:
+
+host: $(HOST_LIB) $(HOST_PROGS)
+
+$(HOST_LIB): $(HOST_OBJS)
+	ar rcs $@ $^
+
+$(HOST_BUILD)/%: $(HOST_BUILD)/obj/%.o $(HOST_BENCHOBJS) $(HOST_LIB)
+	$(HOST_CC) $^ $(HOST_LDLIBS) -o $@
+
+$(HOST_BUILD)/obj/%.o: %.c | $(HOST_BUILD)/obj
+	$(HOST_CC) $(HOST_CFLAGS) $(HOST_INCDIR) -MMD -MP -c $< -o $@
+
+$(HOST_BUILD)/obj:
+	mkdir -p $@
+
+host-check: host
+	$(HOST_BUILD)/bench_atan2
+	$(HOST_BUILD)/bench_vision -g $(HOST_VISION_GOLDEN)
+	$(HOST_BUILD)/bench_audio --check $(HOST_CODE_CHECK) -d pn --code pn
+	$(HOST_BUILD)/bench_audio --check $(HOST_CODE_CHECK) -d chirp --code chirp
+
+host-compare-q15: host
+	$(MAKE) host HOST_BUILD=$(HOST_Q15_BUILD) HOST_DEFS="$(HOST_DEFS) -DAUDIO_Q15"
+	$(HOST_BUILD)/bench_audio $(HOST_COMPARE_SRC) -n $(HOST_COMPARE_LENGTH) -t $(HOST_BUILD)/traj_float.csv
+	$(HOST_Q15_BUILD)/bench_audio $(HOST_COMPARE_SRC) -n $(HOST_COMPARE_LENGTH) -t $(HOST_Q15_BUILD)/traj_q15.csv
+	$(HOST_BUILD)/compare_traj $(HOST_BUILD)/traj_float.csv $(HOST_Q15_BUILD)/traj_q15.csv
+
+host-clean:
+	rm -rf $(HOST_BUILD) $(HOST_Q15_BUILD)
+
+-include $(HOST_OBJS:.o=.d) $(HOST_BENCHOBJS:.o=.d) $(HOST_BENCHES:%=$(HOST_BUILD)/obj/%.d)
@@ -0,0 +1,81 @@
+/*
+
+File    : arm_math.h (host stub)
+
+Portable stand-in for the subset of the CMSIS-DSP library used by the project modules.
+The functions follow the CMSIS semantics (forward transform with e^-j, inverse scaled by 1/N)
+but are plain C and make no attempt at being fast.
+*/
+
+#ifndef ARM_MATH_H
+#define ARM_MATH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef PI
+#define PI						3.14159265358979f
+#endif
+
+typedef float float32_t;
+typedef int16_t q15_t;
+typedef int32_t q31_t;
+
+typedef enum {
+	ARM_MATH_SUCCESS = 0,
+	ARM_MATH_ARGUMENT_ERROR = -1,
+	ARM_MATH_LENGTH_ERROR = -2,
+} arm_status;
+
+//Complex FFT instance, only the length is used by the stub
+typedef struct {
+	uint16_t fftLen;
+} arm_cfft_instance_f32;
+
+void arm_cfft_f32(const arm_cfft_instance_f32 *S, float32_t *p1, uint8_t ifftFlag, uint8_t bitReverseFlag);
+
+//Real FFT instance, built on a complex FFT of half the length
+typedef struct {
+	arm_cfft_instance_f32 Sint;
+	uint16_t fftLenRFFT;
+} arm_rfft_fast_instance_f32;
+
+arm_status arm_rfft_fast_init_f32(arm_rfft_fast_instance_f32 *S, uint16_t fftLen);
+
+//Real FFT, p is used as scratch. pOut = [X0, X(N/2), re X1, im X1, ..., re X(N/2-1), im X(N/2-1)]
+void arm_rfft_fast_f32(arm_rfft_fast_instance_f32 *S, float32_t *p, float32_t *pOut, uint8_t ifftFlag);
+
+void arm_cmplx_mag_f32(float32_t *pSrc, float32_t *pDst, uint32_t numSamples);
+
+//Largest value of pSrc and the index of its first occurrence
+void arm_max_f32(float32_t *pSrc, uint32_t blockSize, float32_t *pResult, uint32_t *pIndex);
+
+//FIR filter followed by a decimation by M, only the kept outputs are computed
+typedef struct {
+	uint8_t M;
+	uint16_t numTaps;
+	const float32_t *pCoeffs;
+	float32_t *pState;
+} arm_fir_decimate_instance_f32;
+
+//pState must hold numTaps + blockSize - 1 values, blockSize must be a multiple of M
+arm_status arm_fir_decimate_init_f32(arm_fir_decimate_instance_f32 *S, uint16_t numTaps, uint8_t M,
+		const float32_t *pCoeffs, float32_t *pState, uint32_t blockSize);
+
+//Filters blockSize samples and writes blockSize / M outputs
+void arm_fir_decimate_f32(const arm_fir_decimate_instance_f32 *S, const float32_t *pSrc, float32_t *pDst, uint32_t blockSize);
+
+//Q15 complex FFT instance, only the length is used by the stub
+typedef struct {
+	uint16_t fftLen;
+} arm_cfft_instance_q15;
+
+//Q15 complex FFT, the output is scaled down by fftLen (11.5 format with 1024 points)
+void arm_cfft_q15(const arm_cfft_instance_q15 *S, q15_t *p1, uint8_t ifftFlag, uint8_t bitReverseFlag);
+
+//Q15 magnitudes, 1.15 input and 2.14 output
+void arm_cmplx_mag_q15(q15_t *pSrc, q15_t *pDst, uint32_t numSamples);
+
+#endif /* ARM_MATH_H */
@@ -0,0 +1,26 @@
+/*
+
+File    : audio/microphone.h (host stub)
+
+Stand-in for the e-puck2 microphone driver. The host harnesses call the registered
+callback themselves with recorded data.
+*/
+
+#ifndef MICROPHONE_H
+#define MICROPHONE_H
+
+#include <stdint.h>
+
+#define MIC_RIGHT				0
+#define MIC_LEFT				1
+#define MIC_BACK				2
+#define MIC_FRONT				3
+
+#define MIC_BUFFER_LEN			640		//4 microphones * 160 samples (10ms at 16kHz)
+
+void mic_start(void (*callback_fn)(int16_t *data, uint16_t num_samples));
+
+//Host only : returns the callback given to mic_start (NULL if none)
+void (*mic_get_callback(void))(int16_t *data, uint16_t num_samples);
+
+#endif /* MICROPHONE_H */
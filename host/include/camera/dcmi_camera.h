@@ -0,0 +1,28 @@
+/*
+
+File    : camera/dcmi_camera.h (host stub)
+*/
+
+#ifndef DCMI_CAMERA_H
+#define DCMI_CAMERA_H
+
+#include <stdint.h>
+
+typedef enum {
+	CAPTURE_ONE_SHOT = 0,
+	CAPTURE_CONTINUOUS,
+} capture_mode_t;
+
+void dcmi_start(void);
+void dcmi_enable_double_buffering(void);
+void dcmi_disable_double_buffering(void);
+void dcmi_set_capture_mode(capture_mode_t mode);
+int8_t dcmi_prepare(void);
+void dcmi_capture_start(void);
+void wait_image_ready(void);
+uint8_t* dcmi_get_last_image_ptr(void);
+
+//Host only : sets the buffer returned by dcmi_get_last_image_ptr
+void dcmi_set_last_image_ptr(uint8_t *buffer);
+
+#endif /* DCMI_CAMERA_H */
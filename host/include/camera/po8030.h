@@ -0,0 +1,30 @@
+/*
+
+File    : camera/po8030.h (host stub)
+*/
+
+#ifndef PO8030_H
+#define PO8030_H
+
+#include <stdint.h>
+#include "dcmi_camera.h"
+
+typedef enum {
+	FORMAT_CBYYCRYY = 0x00,
+	FORMAT_CBYCRY = 0x01,
+	FORMAT_RGB565 = 0x30,
+	FORMAT_YYYY = 0x44,
+	FORMAT_YUV422 = 0x02,
+} format_t;
+
+typedef enum {
+	SUBSAMPLING_X1 = 0x20,
+	SUBSAMPLING_X2 = 0x40,
+	SUBSAMPLING_X4 = 0x80,
+} subsampling_t;
+
+void po8030_start(void);
+int8_t po8030_advanced_config(format_t fmt, unsigned int x1, unsigned int y1,
+				unsigned int width, unsigned int height, subsampling_t subsampling_x, subsampling_t subsampling_y);
+
+#endif /* PO8030_H */
@@ -0,0 +1,99 @@
+/*
+
+File    : ch.h (host stub)
+
+Minimal stand-in for the ChibiOS/RT kernel API used by the project modules,
+so that they can be compiled and run on a Linux workstation.
+Threads and semaphores are mapped onto pthreads, the system tick is 1 ms
+(CH_CFG_ST_FREQUENCY = 1000 in chconf.h) and the realtime counter counts nanoseconds.
+The states of the calls are checked like with CH_DBG_SYSTEM_STATE_CHECK and CH_DBG_ENABLE_ASSERTS
+in chconf.h : a normal API in the critical zone, an I-class or S-class one outside of it, and a thread
+leaving the zone after waking up another one without chSchRescheduleS halt. The priorities are not
+emulated, so every wakeup from a thread must be rescheduled, as one of a higher priority would be.
+*/
+
+#ifndef CH_H
+#define CH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#ifndef TRUE
+#define TRUE					1
+#endif
+#ifndef FALSE
+#define FALSE					0
+#endif
+
+#define CH_CFG_ST_FREQUENCY		1000
+
+//Priorities
+typedef uint32_t tprio_t;
+#define NORMALPRIO				128
+#define HIGHPRIO				255
+#define LOWPRIO					2
+
+//Time
+typedef uint32_t systime_t;
+typedef uint32_t rtcnt_t;
+#define TIME_IMMEDIATE			((systime_t)0)
+#define TIME_INFINITE			((systime_t)-1)
+#define MS2ST(msec)				((systime_t)(msec))
+#define ST2MS(n)				((uint32_t)(n))
+//Converts a realtime counter interval into microseconds
+#define RTC2US(freq, n)			((uint32_t)(((uint64_t)(n) * 1000000U) / (freq)))
+
+//Message codes
+typedef int32_t msg_t;
+#define MSG_OK					((msg_t)0)
+#define MSG_TIMEOUT				((msg_t)-1)
+#define MSG_RESET				((msg_t)-2)
+
+//Threads
+typedef struct thread {
+	pthread_t handle;
+} thread_t;
+typedef void (*tfunc_t)(void *arg);
+
+#define THD_WORKING_AREA(s, n)	uint8_t s[n]
+#define THD_FUNCTION(tname, arg) void tname(void *arg)
+
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg);
+tprio_t chThdSetPriority(tprio_t newprio);
+void chThdSleepMilliseconds(uint32_t msec);
+void chThdSleep(systime_t time);
+#define chRegSetThreadName(name) ((void)(name))
+
+//System
+systime_t chVTGetSystemTime(void);
+systime_t chVTGetSystemTimeX(void);
+rtcnt_t chSysGetRealtimeCounterX(void);
+void chSysLock(void);
+void chSysUnlock(void);
+void chSysLockFromISR(void);
+void chSysUnlockFromISR(void);
+void chSchRescheduleS(void);
+void chSysHalt(const char *reason);
+void chSysInit(void);
+
+//Binary semaphores
+typedef struct {
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	bool taken;
+} binary_semaphore_t;
+
+#define _BSEMAPHORE_DATA(name, taken) \
+	{PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, (taken)}
+#define BSEMAPHORE_DECL(name, taken) \
+	binary_semaphore_t name = _BSEMAPHORE_DATA(name, taken)
+
+void chBSemObjectInit(binary_semaphore_t *bsp, bool taken);
+msg_t chBSemWait(binary_semaphore_t *bsp);
+msg_t chBSemWaitTimeout(binary_semaphore_t *bsp, systime_t time);
+void chBSemSignal(binary_semaphore_t *bsp);
+void chBSemSignalI(binary_semaphore_t *bsp);
+
+#endif /* CH_H */
@@ -0,0 +1,23 @@
+/*
+
+File    : flash/flash.h (host stub)
+*/
+
+#ifndef FLASH_H
+#define FLASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+void flash_unlock(void);
+void flash_lock(void);
+void flash_sector_erase(uint8_t *sector);
+void flash_write(void *dst, const void *src, size_t len);
+
+#define CONFIG_SECTOR_SIZE		16384	//Host only : [bytes] Size of the configuration sector
+
+//Host only : configuration sector, given by the linker script on the robot. It starts erased, the harnesses
+//can fill it from a file and save it back
+extern uint8_t _config_start[CONFIG_SECTOR_SIZE];
+
+#endif /* FLASH_H */
@@ -0,0 +1,18 @@
+/*
+
+File    : hal.h (host stub)
+
+Minimal stand-in for the ChibiOS/HAL used by the project modules on a Linux workstation.
+The realtime counter of the host stub counts nanoseconds, hence the 1 GHz "system clock".
+*/
+
+#ifndef HAL_H
+#define HAL_H
+
+#include "ch.h"
+
+#define STM32_SYSCLK			1000000000U
+
+void halInit(void);
+
+#endif /* HAL_H */
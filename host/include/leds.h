@@ -0,0 +1,21 @@
+/*
+
+File    : leds.h (host stub)
+*/
+
+#ifndef LEDS_H
+#define LEDS_H
+
+typedef enum {
+	LED1,
+	LED3,
+	LED5,
+	LED7,
+	NUM_LED,
+} led_name_t;
+
+void set_led(led_name_t led_number, unsigned int value);
+void set_body_led(unsigned int value);
+void set_front_led(unsigned int value);
+
+#endif /* LEDS_H */
@@ -0,0 +1,11 @@
+/*
+
+File    : memory_protection.h (host stub)
+*/
+
+#ifndef MEMORY_PROTECTION_H
+#define MEMORY_PROTECTION_H
+
+void mpu_init(void);
+
+#endif /* MEMORY_PROTECTION_H */
@@ -0,0 +1,21 @@
+/*
+
+File    : motors.h (host stub)
+
+Stand-in for the e-puck2 stepper motor driver. Speeds are in [step/s].
+*/
+
+#ifndef MOTORS_H
+#define MOTORS_H
+
+#include <stdint.h>
+
+void motors_init(void);
+void left_motor_set_speed(int speed);
+void right_motor_set_speed(int speed);
+int32_t left_motor_get_pos(void);
+int32_t right_motor_get_pos(void);
+void left_motor_set_pos(int32_t counter_value);
+void right_motor_set_pos(int32_t counter_value);
+
+#endif /* MOTORS_H */
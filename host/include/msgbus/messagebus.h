@@ -0,0 +1,11 @@
+/*
+
+File    : msgbus/messagebus.h (host stub)
+*/
+
+#ifndef MESSAGEBUS_H
+#define MESSAGEBUS_H
+
+typedef struct messagebus messagebus_t;
+
+#endif /* MESSAGEBUS_H */
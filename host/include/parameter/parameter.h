@@ -0,0 +1,11 @@
+/*
+
+File    : parameter/parameter.h (host stub)
+*/
+
+#ifndef PARAMETER_H
+#define PARAMETER_H
+
+typedef struct parameter_namespace parameter_namespace_t;
+
+#endif /* PARAMETER_H */
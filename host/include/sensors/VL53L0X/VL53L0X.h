@@ -0,0 +1,17 @@
+/*
+
+File    : sensors/VL53L0X/VL53L0X.h (host stub)
+*/
+
+#ifndef VL53L0X_H
+#define VL53L0X_H
+
+#include <stdint.h>
+
+void VL53L0X_start(void);
+uint16_t VL53L0X_get_dist_mm(void);
+
+//Host only : sets the distance returned by VL53L0X_get_dist_mm
+void VL53L0X_set_dist_mm(uint16_t dist);
+
+#endif /* VL53L0X_H */
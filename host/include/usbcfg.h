@@ -0,0 +1,11 @@
+/*
+
+File    : usbcfg.h (host stub)
+*/
+
+#ifndef USBCFG_H
+#define USBCFG_H
+
+void usb_start(void);
+
+#endif /* USBCFG_H */
@@ -0,0 +1,324 @@
+/*
+
+File    : arm_math_stub.c
+
+Host implementation of the CMSIS-DSP subset declared in host/include/arm_math.h
+*/
+
+#include <pthread.h>
+
+#include "arm_math.h"
+#include "arm_const_structs.h"
+
+#define MAX_LOG2_LEN			13		//Twiddle tables are cached for lengths up to 8192
+
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len16 = {16};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len32 = {32};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len64 = {64};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len128 = {128};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len256 = {256};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len512 = {512};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len1024 = {1024};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len2048 = {2048};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len4096 = {4096};
+
+const arm_cfft_instance_q15 arm_cfft_sR_q15_len16 = {16};
+const arm_cfft_instance_q15 arm_cfft_sR_q15_len32 = {32};
+const arm_cfft_instance_q15 arm_cfft_sR_q15_len64 = {64};
+const arm_cfft_instance_q15 arm_cfft_sR_q15_len128 = {128};
+const arm_cfft_instance_q15 arm_cfft_sR_q15_len256 = {256};
+const arm_cfft_instance_q15 arm_cfft_sR_q15_len512 = {512};
+const arm_cfft_instance_q15 arm_cfft_sR_q15_len1024 = {1024};
+const arm_cfft_instance_q15 arm_cfft_sR_q15_len2048 = {2048};
+const arm_cfft_instance_q15 arm_cfft_sR_q15_len4096 = {4096};
+
+
+/*
+*	Returns the table of the n/2 twiddles e^(-j2pi k/n) as [real, imag] pairs, computed in double
+*	precision on first use and cached, like the constant tables of CMSIS
+*/
+static const float32_t *twiddle_table(uint32_t n)
+{
+	static float32_t *tables[MAX_LOG2_LEN + 1];
+	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	uint32_t log2n = 0;
+
+	while((1U << log2n) < n){log2n++;}
+	if(log2n > MAX_LOG2_LEN){abort();}
+
+	pthread_mutex_lock(&lock);
+	if(tables[log2n] == NULL)
+	{
+		float32_t *table = malloc(n * sizeof(float32_t));
+		if(table == NULL){abort();}
+		for(uint32_t k = 0 ; k < n / 2 ; k++)
+		{
+			table[2*k] = (float32_t)cos(2.0 * M_PI * k / n);
+			table[2*k+1] = (float32_t)-sin(2.0 * M_PI * k / n);
+		}
+		tables[log2n] = table;
+	}
+	pthread_mutex_unlock(&lock);
+	return tables[log2n];
+}
+
+
+/*
+*	In-place radix-2 complex FFT on interleaved [real, imag] data.
+*	Forward transform uses e^(-j2pi/N), the inverse one e^(+j2pi/N) and a 1/N scaling,
+*	as arm_cfft_f32 does.
+*/
+void arm_cfft_f32(const arm_cfft_instance_f32 *S, float32_t *p1, uint8_t ifftFlag, uint8_t bitReverseFlag)
+{
+	uint32_t n = S->fftLen;
+	const float32_t *twiddle = twiddle_table(n);
+	float32_t sign = ifftFlag ? -1.0f : 1.0f;
+	float32_t tr, ti;
+
+	//Bit reversal permutation
+	if(bitReverseFlag)
+	{
+		for(uint32_t i = 1, j = 0 ; i < n ; i++)
+		{
+			uint32_t bit = n >> 1;
+			for( ; j & bit ; bit >>= 1)
+			{
+				j ^= bit;
+			}
+			j ^= bit;
+			if(i < j)
+			{
+				tr = p1[2*i];		ti = p1[2*i+1];
+				p1[2*i] = p1[2*j];	p1[2*i+1] = p1[2*j+1];
+				p1[2*j] = tr;		p1[2*j+1] = ti;
+			}
+		}
+	}
+
+	//Butterflies
+	for(uint32_t len = 2 ; len <= n ; len <<= 1)
+	{
+		uint32_t half = len >> 1;
+		uint32_t step = n / len;
+		for(uint32_t m = 0 ; m < half ; m++)
+		{
+			float32_t wr = twiddle[2*m*step];
+			float32_t wi = sign * twiddle[2*m*step+1];
+			for(uint32_t i = m ; i < n ; i += len)
+			{
+				uint32_t k = i + half;
+				tr = wr * p1[2*k] - wi * p1[2*k+1];
+				ti = wr * p1[2*k+1] + wi * p1[2*k];
+				p1[2*k] = p1[2*i] - tr;
+				p1[2*k+1] = p1[2*i+1] - ti;
+				p1[2*i] += tr;
+				p1[2*i+1] += ti;
+			}
+		}
+	}
+
+	if(ifftFlag)
+	{
+		float32_t scale = 1.0f / n;
+		for(uint32_t i = 0 ; i < 2*n ; i++)
+		{
+			p1[i] *= scale;
+		}
+	}
+}
+
+
+arm_status arm_rfft_fast_init_f32(arm_rfft_fast_instance_f32 *S, uint16_t fftLen)
+{
+	//Same lengths as the CMSIS tables
+	if(fftLen < 32 || fftLen > 4096 || (fftLen & (fftLen - 1)))
+	{
+		return ARM_MATH_ARGUMENT_ERROR;
+	}
+	S->fftLenRFFT = fftLen;
+	S->Sint.fftLen = fftLen / 2;
+	return ARM_MATH_SUCCESS;
+}
+
+
+/*
+*	Real FFT of length N computed with a complex FFT of length N/2 on the samples packed as
+*	z[n] = x[2n] + j*x[2n+1], followed by the split step separating the even and odd samples spectra.
+*/
+void arm_rfft_fast_f32(arm_rfft_fast_instance_f32 *S, float32_t *p, float32_t *pOut, uint8_t ifftFlag)
+{
+	uint32_t n = S->fftLenRFFT;
+	uint32_t half = n / 2;
+	const float32_t *twiddle = twiddle_table(n);
+
+	if(!ifftFlag)
+	{
+		arm_cfft_f32(&S->Sint, p, 0, 1);
+
+		//DC and Nyquist are both real, packed in the first complex value
+		pOut[0] = p[0] + p[1];
+		pOut[1] = p[0] - p[1];
+		for(uint32_t k = 1 ; k < half ; k++)
+		{
+			//E = (Z[k] + conj(Z[N/2-k]))/2 and O = -j(Z[k] - conj(Z[N/2-k]))/2
+			float32_t er = 0.5f * (p[2*k] + p[2*(half-k)]);
+			float32_t ei = 0.5f * (p[2*k+1] - p[2*(half-k)+1]);
+			float32_t or = 0.5f * (p[2*k+1] + p[2*(half-k)+1]);
+			float32_t oi = -0.5f * (p[2*k] - p[2*(half-k)]);
+			float32_t wr = twiddle[2*k], wi = twiddle[2*k+1];
+			//X[k] = E + W^k O
+			pOut[2*k] = er + wr * or - wi * oi;
+			pOut[2*k+1] = ei + wr * oi + wi * or;
+		}
+	}
+	else
+	{
+		//Inverse of the split step, then an inverse complex FFT of length N/2
+		pOut[0] = 0.5f * (p[0] + p[1]);
+		pOut[1] = 0.5f * (p[0] - p[1]);
+		for(uint32_t k = 1 ; k < half ; k++)
+		{
+			//E = (X[k] + conj(X[N/2-k]))/2 and O = (X[k] - conj(X[N/2-k])) W^-k / 2
+			float32_t er = 0.5f * (p[2*k] + p[2*(half-k)]);
+			float32_t ei = 0.5f * (p[2*k+1] - p[2*(half-k)+1]);
+			float32_t dr = 0.5f * (p[2*k] - p[2*(half-k)]);
+			float32_t di = 0.5f * (p[2*k+1] + p[2*(half-k)+1]);
+			float32_t wr = twiddle[2*k], wi = -twiddle[2*k+1];
+			float32_t or = dr * wr - di * wi;
+			float32_t oi = dr * wi + di * wr;
+			//Z[k] = E + jO
+			pOut[2*k] = er - oi;
+			pOut[2*k+1] = ei + or;
+		}
+		arm_cfft_f32(&S->Sint, pOut, 1, 1);
+	}
+}
+
+
+void arm_cmplx_mag_f32(float32_t *pSrc, float32_t *pDst, uint32_t numSamples)
+{
+	for(uint32_t i = 0 ; i < numSamples ; i++)
+	{
+		pDst[i] = sqrtf(pSrc[2*i] * pSrc[2*i] + pSrc[2*i+1] * pSrc[2*i+1]);
+	}
+}
+
+
+void arm_max_f32(float32_t *pSrc, uint32_t blockSize, float32_t *pResult, uint32_t *pIndex)
+{
+	uint32_t index = 0;
+	for(uint32_t i = 1 ; i < blockSize ; i++)
+	{
+		if(pSrc[i] > pSrc[index]){index = i;}
+	}
+	*pResult = pSrc[index];
+	*pIndex = index;
+}
+
+
+arm_status arm_fir_decimate_init_f32(arm_fir_decimate_instance_f32 *S, uint16_t numTaps, uint8_t M,
+		const float32_t *pCoeffs, float32_t *pState, uint32_t blockSize)
+{
+	if(M == 0 || blockSize % M)
+	{
+		return ARM_MATH_LENGTH_ERROR;
+	}
+	S->M = M;
+	S->numTaps = numTaps;
+	S->pCoeffs = pCoeffs;
+	S->pState = pState;
+	memset(pState, 0, (numTaps + blockSize - 1) * sizeof(float32_t));
+	return ARM_MATH_SUCCESS;
+}
+
+
+/*
+*	The state keeps the last numTaps - 1 inputs in front of the new block. Like in CMSIS, the
+*	coefficients are stored in time reversed order : pCoeffs[0] multiplies the oldest sample
+*/
+void arm_fir_decimate_f32(const arm_fir_decimate_instance_f32 *S, const float32_t *pSrc, float32_t *pDst, uint32_t blockSize)
+{
+	float32_t *state = S->pState;
+	uint32_t history = S->numTaps - 1;
+
+	memcpy(&state[history], pSrc, blockSize * sizeof(float32_t));
+	for(uint32_t n = 0 ; n < blockSize / S->M ; n++)
+	{
+		//Oldest sample of the output n, its newest one is the input nM + M - 1
+		const float32_t *x = &state[n * S->M + S->M - 1];
+		float32_t acc = 0;
+		for(uint32_t k = 0 ; k < S->numTaps ; k++)
+		{
+			acc += S->pCoeffs[k] * x[k];
+		}
+		pDst[n] = acc;
+	}
+	memmove(state, &state[blockSize], history * sizeof(float32_t));
+}
+
+
+/*
+*	In-place radix-2 complex FFT on interleaved Q15 data, in fixed point.
+*	Every stage halves its outputs (truncating) so that nothing overflows, the result is
+*	scaled down by N like the one of arm_cfft_q15, with a similar quantization noise.
+*/
+void arm_cfft_q15(const arm_cfft_instance_q15 *S, q15_t *p1, uint8_t ifftFlag, uint8_t bitReverseFlag)
+{
+	uint32_t n = S->fftLen;
+	const float32_t *twiddle = twiddle_table(n);
+	q31_t sign = ifftFlag ? -1 : 1;
+	q31_t tr, ti;
+
+	//Bit reversal permutation
+	if(bitReverseFlag)
+	{
+		for(uint32_t i = 1, j = 0 ; i < n ; i++)
+		{
+			uint32_t bit = n >> 1;
+			for( ; j & bit ; bit >>= 1)
+			{
+				j ^= bit;
+			}
+			j ^= bit;
+			if(i < j)
+			{
+				q15_t r = p1[2*i], im = p1[2*i+1];
+				p1[2*i] = p1[2*j];	p1[2*i+1] = p1[2*j+1];
+				p1[2*j] = r;		p1[2*j+1] = im;
+			}
+		}
+	}
+
+	//Butterflies with Q15 twiddles and Q30 products
+	for(uint32_t len = 2 ; len <= n ; len <<= 1)
+	{
+		uint32_t half = len >> 1;
+		uint32_t step = n / len;
+		for(uint32_t m = 0 ; m < half ; m++)
+		{
+			q31_t wr = (q31_t)lrintf(twiddle[2*m*step] * 32767.0f);
+			q31_t wi = sign * (q31_t)lrintf(twiddle[2*m*step+1] * 32767.0f);
+			for(uint32_t i = m ; i < n ; i += len)
+			{
+				uint32_t k = i + half;
+				tr = (wr * p1[2*k] - wi * p1[2*k+1]) >> 15;
+				ti = (wr * p1[2*k+1] + wi * p1[2*k]) >> 15;
+				p1[2*k] = (q15_t)((p1[2*i] - tr) >> 1);
+				p1[2*k+1] = (q15_t)((p1[2*i+1] - ti) >> 1);
+				p1[2*i] = (q15_t)((p1[2*i] + tr) >> 1);
+				p1[2*i+1] = (q15_t)((p1[2*i+1] + ti) >> 1);
+			}
+		}
+	}
+}
+
+
+//Same arithmetic as CMSIS : Q30 sum of squares shifted to Q13, then a Q15 square root
+void arm_cmplx_mag_q15(q15_t *pSrc, q15_t *pDst, uint32_t numSamples)
+{
+	for(uint32_t i = 0 ; i < numSamples ; i++)
+	{
+		int64_t acc = (int64_t)pSrc[2*i] * pSrc[2*i] + (int64_t)pSrc[2*i+1] * pSrc[2*i+1];
+		pDst[i] = (q15_t)sqrt((double)(acc >> 17) * 32768.0);
+	}
+}
@@ -0,0 +1,266 @@
+/*
+
+File    : chibios_stub.c
+
+Host implementation of the ChibiOS/RT stand-in declared in host/include/ch.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+
+#include "ch.h"
+#include "hal.h"
+
+//Global lock emulating the kernel critical zone
+static pthread_mutex_t sys_lock = PTHREAD_MUTEX_INITIALIZER;
+//State of the calling thread : inside the critical zone, and woke up another thread since it entered it
+static __thread bool sys_locked;
+static __thread bool sys_wakeup;
+
+
+//Halts if the calling thread is not in the state required by the API name, like CH_DBG_SYSTEM_STATE_CHECK
+static void check_state(bool locked, const char *name)
+{
+	if(sys_locked != locked)
+	{
+		fprintf(stderr, "chSysHalt: SV#4 %s called %s the critical zone\n", name, locked ? "outside" : "inside");
+		abort();
+	}
+}
+
+
+//Returns the monotonic clock in nanoseconds
+static uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+//Adds time [ms] to the realtime clock to build an absolute deadline for pthread_cond_timedwait
+static struct timespec deadline_ms(uint32_t msec)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += msec / 1000;
+	ts.tv_nsec += (long)(msec % 1000) * 1000000L;
+	if(ts.tv_nsec >= 1000000000L)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	return ts;
+}
+
+
+//Pthreads entry point, unpacks the ChibiOS thread function and its argument
+struct thread_start {
+	tfunc_t pf;
+	void *arg;
+};
+
+static void *thread_entry(void *p)
+{
+	struct thread_start start = *(struct thread_start *)p;
+	free(p);
+	start.pf(start.arg);
+	return NULL;
+}
+
+
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg)
+{
+	//The working area is used to store the thread descriptor, like in ChibiOS
+	thread_t *tp = (thread_t *)wsp;
+	struct thread_start *start = malloc(sizeof(*start));
+	(void)prio;
+
+	if(size < sizeof(thread_t) || start == NULL)
+	{
+		chSysHalt("chThdCreateStatic: invalid working area");
+	}
+	start->pf = pf;
+	start->arg = arg;
+	if(pthread_create(&tp->handle, NULL, thread_entry, start) != 0)
+	{
+		chSysHalt("chThdCreateStatic: pthread_create failed");
+	}
+	pthread_detach(tp->handle);
+	return tp;
+}
+
+
+tprio_t chThdSetPriority(tprio_t newprio)
+{
+	//Priorities are not emulated on the host
+	return newprio;
+}
+
+
+void chThdSleepMilliseconds(uint32_t msec)
+{
+	struct timespec ts = {msec / 1000, (long)(msec % 1000) * 1000000L};
+	check_state(FALSE, "chThdSleepMilliseconds");
+	while(nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+
+void chThdSleep(systime_t time)
+{
+	chThdSleepMilliseconds(ST2MS(time));
+}
+
+
+systime_t chVTGetSystemTime(void)
+{
+	//Enters the critical zone on the target
+	check_state(FALSE, "chVTGetSystemTime");
+	return chVTGetSystemTimeX();
+}
+
+
+systime_t chVTGetSystemTimeX(void)
+{
+	return (systime_t)(monotonic_ns() / 1000000ULL);
+}
+
+
+rtcnt_t chSysGetRealtimeCounterX(void)
+{
+	return (rtcnt_t)monotonic_ns();
+}
+
+
+void chSysLock(void)
+{
+	check_state(FALSE, "chSysLock");
+	pthread_mutex_lock(&sys_lock);
+	sys_locked = TRUE;
+	sys_wakeup = FALSE;
+}
+
+
+void chSysUnlock(void)
+{
+	check_state(TRUE, "chSysUnlock");
+	if(sys_wakeup)
+	{
+		//The woken up thread could have a higher priority than the running one
+		chSysHalt("chSysUnlock: priority order violation, chSchRescheduleS missing");
+	}
+	sys_locked = FALSE;
+	pthread_mutex_unlock(&sys_lock);
+}
+
+
+void chSysLockFromISR(void)
+{
+	chSysLock();
+}
+
+
+void chSysUnlockFromISR(void)
+{
+	//The interrupt exit reschedules
+	sys_wakeup = FALSE;
+	chSysUnlock();
+}
+
+
+void chSchRescheduleS(void)
+{
+	check_state(TRUE, "chSchRescheduleS");
+	sys_wakeup = FALSE;
+}
+
+
+void chSysHalt(const char *reason)
+{
+	fprintf(stderr, "chSysHalt: %s\n", reason);
+	abort();
+}
+
+
+void chSysInit(void)
+{
+}
+
+
+void chBSemObjectInit(binary_semaphore_t *bsp, bool taken)
+{
+	pthread_mutex_init(&bsp->mtx, NULL);
+	pthread_cond_init(&bsp->cond, NULL);
+	bsp->taken = taken;
+}
+
+
+msg_t chBSemWait(binary_semaphore_t *bsp)
+{
+	return chBSemWaitTimeout(bsp, TIME_INFINITE);
+}
+
+
+msg_t chBSemWaitTimeout(binary_semaphore_t *bsp, systime_t time)
+{
+	msg_t msg = MSG_OK;
+	struct timespec deadline = deadline_ms(ST2MS(time));
+
+	check_state(FALSE, "chBSemWaitTimeout");
+	pthread_mutex_lock(&bsp->mtx);
+	while(bsp->taken)
+	{
+		if(time == TIME_IMMEDIATE)
+		{
+			msg = MSG_TIMEOUT;
+			break;
+		}
+		if(time == TIME_INFINITE)
+		{
+			pthread_cond_wait(&bsp->cond, &bsp->mtx);
+		}
+		else if(pthread_cond_timedwait(&bsp->cond, &bsp->mtx, &deadline) == ETIMEDOUT)
+		{
+			msg = bsp->taken ? MSG_TIMEOUT : MSG_OK;
+			break;
+		}
+	}
+	if(msg == MSG_OK)
+	{
+		bsp->taken = TRUE;
+	}
+	pthread_mutex_unlock(&bsp->mtx);
+	return msg;
+}
+
+
+//Releases the semaphore and wakes up its waiter
+static void bsem_release(binary_semaphore_t *bsp)
+{
+	pthread_mutex_lock(&bsp->mtx);
+	bsp->taken = FALSE;
+	pthread_cond_signal(&bsp->cond);
+	pthread_mutex_unlock(&bsp->mtx);
+}
+
+
+void chBSemSignal(binary_semaphore_t *bsp)
+{
+	check_state(FALSE, "chBSemSignal");
+	bsem_release(bsp);
+}
+
+
+void chBSemSignalI(binary_semaphore_t *bsp)
+{
+	check_state(TRUE, "chBSemSignalI");
+	bsem_release(bsp);
+	sys_wakeup = TRUE;
+}
+
+
+void halInit(void)
+{
+}
@@ -0,0 +1,98 @@
+/*
+
+File    : hal_stub.c
+
+Host implementation of the e-puck2 drivers (motors, leds, ToF, camera, microphones, flash, usb)
+used by the project modules. The drivers only record what they are given so that the
+host harnesses can inspect and drive them.
+*/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include <usbcfg.h>
+#include <memory_protection.h>
+#include <motors.h>
+#include <leds.h>
+#include <audio/microphone.h>
+#include <sensors/VL53L0X/VL53L0X.h>
+#include <camera/po8030.h>
+#include <flash/flash.h>
+
+#define HOST_DEFAULT_DIST		1000	//[mm] Free space in front of the robot
+
+static int left_speed = 0, right_speed = 0;
+static int32_t left_pos = 0, right_pos = 0;
+static unsigned int led_state[NUM_LED];
+static unsigned int body_led = 0, front_led = 0;
+static uint16_t tof_dist = HOST_DEFAULT_DIST;
+static uint8_t *last_image = NULL;
+static bool flash_unlocked = FALSE;
+static void (*mic_callback)(int16_t *data, uint16_t num_samples) = NULL;
+
+
+//USB and MPU
+void usb_start(void) {}
+void mpu_init(void) {}
+
+//Motors
+void motors_init(void) {}
+void left_motor_set_speed(int speed) {left_speed = speed;}
+void right_motor_set_speed(int speed) {right_speed = speed;}
+int32_t left_motor_get_pos(void) {return left_pos;}
+int32_t right_motor_get_pos(void) {return right_pos;}
+void left_motor_set_pos(int32_t counter_value) {left_pos = counter_value;}
+void right_motor_set_pos(int32_t counter_value) {right_pos = counter_value;}
+
+//Leds
+void set_led(led_name_t led_number, unsigned int value)
+{
+	if(led_number < NUM_LED){led_state[led_number] = value;}
+}
+void set_body_led(unsigned int value) {body_led = value;}
+void set_front_led(unsigned int value) {front_led = value;}
+
+//Time of flight sensor
+void VL53L0X_start(void) {}
+uint16_t VL53L0X_get_dist_mm(void) {return tof_dist;}
+void VL53L0X_set_dist_mm(uint16_t dist) {tof_dist = dist;}
+
+//Flash : like the hardware, writing only clears bits and nothing is changed while the flash is locked
+uint8_t _config_start[CONFIG_SECTOR_SIZE] = {[0 ... CONFIG_SECTOR_SIZE - 1] = 0xFF};
+void flash_unlock(void) {flash_unlocked = TRUE;}
+void flash_lock(void) {flash_unlocked = FALSE;}
+void flash_sector_erase(uint8_t *sector)
+{
+	if(flash_unlocked && sector == _config_start){memset(_config_start, 0xFF, CONFIG_SECTOR_SIZE);}
+}
+void flash_write(void *dst, const void *src, size_t len)
+{
+	for(size_t i = 0 ; i < len && flash_unlocked ; i++)
+	{
+		((uint8_t *)dst)[i] &= ((const uint8_t *)src)[i];
+	}
+}
+
+//Camera
+void dcmi_start(void) {}
+void dcmi_enable_double_buffering(void) {}
+void dcmi_disable_double_buffering(void) {}
+void dcmi_set_capture_mode(capture_mode_t mode) {(void)mode;}
+int8_t dcmi_prepare(void) {return 0;}
+void dcmi_capture_start(void) {}
+void wait_image_ready(void) {}
+uint8_t* dcmi_get_last_image_ptr(void) {return last_image;}
+void dcmi_set_last_image_ptr(uint8_t *buffer) {last_image = buffer;}
+void po8030_start(void) {}
+int8_t po8030_advanced_config(format_t fmt, unsigned int x1, unsigned int y1,
+				unsigned int width, unsigned int height, subsampling_t subsampling_x, subsampling_t subsampling_y)
+{
+	(void)fmt; (void)x1; (void)y1; (void)width; (void)height; (void)subsampling_x; (void)subsampling_y;
+	return 0;
+}
+
+//Microphones
+void mic_start(void (*callback_fn)(int16_t *data, uint16_t num_samples)) {mic_callback = callback_fn;}
+void (*mic_get_callback(void))(int16_t *data, uint16_t num_samples) {return mic_callback;}
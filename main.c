@@ -22,15 +22,40 @@ Adapted from the code given in the EPFL MICRO-315 TP (Spring Semester 2020)
 #include <sensors/VL53L0X/VL53L0X.h>
 #include <camera/po8030.h>
 #include <motors.h>
+#include <leds.h>
+#include <selector.h>
+#include <button.h>
 
 #include <pathing.h>
 #include <process_image.h>
 #include <audio_processing.h>
 
+#define CALIBRATION_SELECTOR	15		//Selector position arming the calibration of the microphones at startup
+#define CALIBRATION_CONFIRM_MS	5000	//[ms] Time given to confirm the calibration with the user button
+#define CALIBRATION_BLINK_MS	250		//[ms] Half period of the front led while waiting for the confirmation
+#define CALIBRATION_TIME_MS		10000	//[ms] Duration of the calibration
+
 //FSM control variables
 static bool move_forward = 0;
 static uint8_t obstacle_type = 0;
 
+//Blinks the front led until the user button is pressed, returns FALSE if it was not within CALIBRATION_CONFIRM_MS
+static bool calibration_confirmed(void)
+{
+	for(uint16_t t = 0 ; t < CALIBRATION_CONFIRM_MS ; t += CALIBRATION_BLINK_MS)
+	{
+		set_front_led((t / CALIBRATION_BLINK_MS) % 2 == 0);
+		chThdSleepMilliseconds(CALIBRATION_BLINK_MS);
+		if(button_is_pressed())
+		{
+			set_front_led(0);
+			return TRUE;
+		}
+	}
+	set_front_led(0);
+	return FALSE;
+}
+
 int main(void)
 {
 	//System and OS initializations
@@ -51,9 +76,23 @@ int main(void)
     //starts the image processing&capturing threads
     process_image_start();
 
-    //starts the microphones processing thread, calls the callback given in parameter when samples are ready
+    //starts the audio DSP thread, then the microphones processing thread which calls the callback given in parameter when samples are ready
+    audio_processing_start();
     mic_start(&processAudioData);
 
+    //Calibration of the microphones, armed by the selector and confirmed with the user button while the front led
+    //blinks, so that a stray selector position never rewrites the flash. The beacon must be straight ahead of the robot
+    //while the body led is on, its frequency is the only point measured (see start_audio_calibration).
+    //The front led stays on if it failed, the previous calibration is then kept
+    if(get_selector() == CALIBRATION_SELECTOR && calibration_confirmed())
+    {
+    	set_body_led(1);
+    	start_audio_calibration(0);
+    	chThdSleepMilliseconds(CALIBRATION_TIME_MS);
+    	set_front_led(!save_audio_calibration());
+    	set_body_led(0);
+    }
+
     //Sets the main thread's priority above the processing threads
     chThdSetPriority(NORMALPRIO +2);
 
@@ -21,20 +21,19 @@ Pathing file implementing the different pathing and movement functions as well a
 #include "leds.h"
 
 //Defines
-#define ROT_COEF 				7			//Experimental value, ROT_COEF * angle gives the speed at which to turn during ROT_TIME
-#define ROT_TIME				500			//[ms] Half a second is needed to have big angles
+#define ROT_COEF 				7			//Experimental value, ROT_COEF * angle gives the speed at which to turn, updated at every audio frame
 #define SAFETY_DISTANCE 		40			//[mm] The robot will go into reverse if he sees anything closer
 #define MAX_TRAVEL_TIME			3000		//[ms] Maximum amount of time the robot will go forward without reorientating itself
 #define MAX_ROT_TIME 			3000		//[ms] Maximum amount of time the robot will spend trying to orientate itself
+#define MAX_AUDIO_WAIT_TIME		3000		//[ms] Maximum amount of time the robot will wait for a confident angle before moving on
 #define COLLISION_DISTANCE 		30			//[mm] Distance at which the robot considers he collided with the gate he was ramming
 #define MINIMUM_ROT_SPEED		175			//Turning at a lower speed starts to make the robot shake instead of turning properly
 #define SLOW_DOWN_DISTANCE		200			//[mm] The robot will slow down at that distance to facilitate the obstacle recognition
 #define SLOW_SPEED				300			//[step/s]
 #define FAST_SPEED				500			//[step/s]
 #define HALT					0			//[step/s]
-#define	LARGE_ANGLE				40			//[degrees] Angle after which the past average of the filter will be reset to fix long convergence times
-#define STABILIZATION_TRIES		5			//Maximum amount of times the angle is polled to determine its stability
-#define STABILIZED_AUDIO		3			//The angle will be considered stable if 3 tries are accepted
+#define MAX_ANGLE_VARIANCE		25.0f		//[degrees^2] The tracked angle is trusted once its standard deviation is below 5 degrees...
+#define MAX_ANGLE_AGE			200			//[ms] ...and it was updated by a frame less than 200ms old
 #define MAX_ANGLE_ERROR			15.0f		//[degrees] The maximum error of the sound localization accuracy
 #define RAM_SPEED				1000		//[step/s]
 #define CELEBRATION_TIME		1000		//[ms]
@@ -45,8 +44,6 @@ Pathing file implementing the different pathing and movement functions as well a
 #define THRESHOLD_GATE			2			//Count of consecutive instances of a gate to confirm it
 #define OBSTACLE_CLEARING_DELAY	500			//[ms] Amount of time needed to complete the rotation
 #define SENSOR_REFRESH_DELAY	100			//[ms] Minimum amount of time between new values dictated by the ToF sensor thread
-#define AUDIO_SETTLING_TIME		1000		//[ms] Thread sleep time needed to allow audio values to stabilize
-#define LARGE_ANGLE_SETTLING	1500		//[ms] Extra thread sleep time needed to allow audio values to stabilize after a large rotation
 
 static uint8_t last_type=0, count=0;
 static uint16_t last_pos=0;
@@ -60,6 +57,7 @@ void set_speed(int speed)
 {
 	left_motor_set_speed(speed);
 	right_motor_set_speed(speed);
+	set_audio_motor_speed(speed, speed);
 }
 
 
@@ -69,6 +67,7 @@ void rotate_lr(int lr)
 	if(abs(lr)<MINIMUM_ROT_SPEED){lr =sign(lr)*MINIMUM_ROT_SPEED;}
 	left_motor_set_speed(lr);
 	right_motor_set_speed(-lr);
+	set_audio_motor_speed(lr, -lr);
 }
 
 
@@ -155,72 +154,86 @@ uint8_t path_to_obstacle (void)
 }
 
 
-//Function to rotate towards the source and look for obstacles, returns the type of the obstacle if any has been found (stored in last_type)
-uint8_t rotate_to_source (void)
+//Returns TRUE when the source is detected and the tracked angle is confident and recent enough to act on
+static bool audio_confident(const audio_snapshot_t* audio)
 {
-	float turnangle = 0;
-	uint8_t check_angle = 0;
-	systime_t start_time = 0;
-	reset_audio();
-
-	//Allows the audio values to settle
-	chThdSleepMilliseconds(AUDIO_SETTLING_TIME);
-
-
-
+	return audio->status && audio->variance < MAX_ANGLE_VARIANCE && audio->age_ms < MAX_ANGLE_AGE;
+}
 
 
-	//Waits for the frequency to be picked up
-	while(!get_audio_status()){chThdSleepMilliseconds(500);}
+//Function to rotate towards the source and look for obstacles, returns the type of the obstacle if any has been found (stored in last_type)
+uint8_t rotate_to_source (void)
+{
+	audio_snapshot_t audio;
+	systime_t start_time = 0, next_check = 0;
+	bool turning = FALSE;
+	get_audio_snapshot(&audio);
 
 	start_time=chVTGetSystemTime();
+	next_check = start_time + MS2ST(SENSOR_REFRESH_DELAY);
 
 	while(1)
 	{
-		check_angle=0;
-		turnangle = get_angle();
-
-		//Rotates at a speed proportional to the angle received from audio processing
-		rotate_lr(ROT_COEF*turnangle);
-		chThdSleepMilliseconds(ROT_TIME);
-		set_speed(HALT);
+		systime_t now = chVTGetSystemTime();
+		//The snapshot is a hop and a frame old, the robot turned meanwhile : get_angle corrects it with the current heading
+		float angle = get_angle();
 
-		//Limits the time spent looking for the audio source
-		if (chVTGetSystemTime()>start_time + MAX_ROT_TIME){break;}
-
-		//If the angle turned was large, reset the audio values and allow more time to settle
-		if (fabs(turnangle)>LARGE_ANGLE){reset_audio();  chThdSleepMilliseconds(LARGE_ANGLE_SETTLING);}
-
-		//Allows the audio values to settle
-		chThdSleepMilliseconds(AUDIO_SETTLING_TIME);
-
-		//Polls the angle data STABILIZATION_TRIES times while allowing sensor refresh and looking for obstacles
-		for(uint8_t i = 0 ; i < STABILIZATION_TRIES; i++)
+		//Starts turning once the frequency is picked up and the angle is confident, MAX_ROT_TIME counts from then
+		if (!turning && audio_confident(&audio))
 		{
-			chThdSleepMilliseconds(SENSOR_REFRESH_DELAY);
-			turnangle = get_angle();
+			turning = TRUE;
+			start_time = now;
+		}
 
-			//Counts polled angles around 0
-			if (fabs(turnangle) < MAX_ANGLE_ERROR && get_audio_status()){check_angle++;}
+		//The tracked angle follows the rotation of the robot, the frames recorded while turning keep updating it
+		if (!turning)
+		{
+			//Waits still for MAX_AUDIO_WAIT_TIME at most, a weak or lost source sends the robot forward again
+			set_speed(HALT);
+			if (now>start_time + MS2ST(MAX_AUDIO_WAIT_TIME)){return FALSE;}
+		}
+		else if (fabs(angle) < MAX_ANGLE_ERROR)
+		{
+			set_speed(HALT);
+			//If the angle is small enough and confident, we return to moving forward (No obstacle = FALSE)
+			if (audio_confident(&audio)){return FALSE;}
+		}
+		else
+		{
+			//Rotates at a speed proportional to the angle received from audio processing
+			rotate_lr(ROT_COEF*angle);
+		}
 
-			//Looks for obstacles
-			if (recognize_obstacle()){return last_type;}
+		//Limits the time spent looking for the audio source
+		if (turning && now>start_time + MAX_ROT_TIME)
+		{
+			set_speed(HALT);
+			return FALSE;
+		}
 
-			//Return UNKNOWN if close unidentified obstacle is detected
-			if(VL53L0X_get_dist_mm()<SAFETY_DISTANCE)
-			{
-				set_speed(HALT);
-				set_body_led(0);
-				return UNKNOWN;
-			}
+		//Checks every new frame, the sensors only once they have refreshed
+		if ((int32_t)(next_check - now) > 0)
+		{
+			wait_audio_frame(&audio, next_check - now);
+			continue;
+		}
+		next_check = now + MS2ST(SENSOR_REFRESH_DELAY);
 
-			//If count is high enough, we return to moving forward (No obstacle = FALSE)
-			if (check_angle>=STABILIZED_AUDIO){ return FALSE;}
+		//Looks for obstacles
+		if (recognize_obstacle())
+		{
+			set_speed(HALT);
+			return last_type;
 		}
 
+		//Return UNKNOWN if close unidentified obstacle is detected
+		if(VL53L0X_get_dist_mm()<SAFETY_DISTANCE)
+		{
+			set_speed(HALT);
+			set_body_led(0);
+			return UNKNOWN;
+		}
 	}
-	//If MAX_ROT_TIME has elapsed, we continue forward with a FALSE = no obstacle
-	return FALSE;
 }
 
 
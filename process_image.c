@@ -9,6 +9,8 @@ Image capturing and processing functions to handle the data from the po8030 came
 Adapted from the code given in the EPFL MICRO-315 TP (Spring Semester 2020)
 */
 
+#include <string.h>
+
 #include "ch.h"
 #include "hal.h"
 #include <usbcfg.h>
@@ -19,8 +21,6 @@ Adapted from the code given in the EPFL MICRO-315 TP (Spring Semester 2020)
 #include <process_image.h>
 
 //Local defines
-#define MAX_OBJECTS				5		//Maximum objects in the line and obstacle arrays
-
 #define IMAGE_BUFFER_SIZE		640 	//Size of the image buffer where the red camera pixel data is stored
 #define WIDTH_SLOPE				5		//Maximum width of the transition from below threshold to above for line extraction
 #define MIN_LINE_WIDTH			40		//Minimum width to qualify as a line
@@ -32,25 +32,13 @@ Adapted from the code given in the EPFL MICRO-315 TP (Spring Semester 2020)
 #define RATIO_TO_CONFIRM_EDGES	0.3		//The higher of the two means for edge deduction must be at least 0.3 times the white line
 #define MIN_LINES_FOR_GOAL		3		//Minimum number to confirm a goal
 
-//Line structure
-struct line {
-	bool exist;
-	uint16_t start;
-	uint16_t end;
-	uint16_t pos;
-	uint16_t meanval;
-};
-
-//Obstacle structure
-struct obstacle{
-	uint8_t type;
-	uint16_t pos;
-};
-
 //The static arrays containing all registered lines and obstacles respectively.
 static struct line current_lines[MAX_OBJECTS];
 static struct obstacle current_obstacles[MAX_OBJECTS];
 
+//Red channel of the last processed image
+static uint8_t image_red[IMAGE_BUFFER_SIZE];
+
 //Semaphore for alerting the process image thread when a new image is ready from the capture image thread
 static BSEMAPHORE_DECL(image_ready_sem, TRUE);
 
@@ -264,6 +252,30 @@ static THD_FUNCTION(CaptureImage, arg)
 }
 
 
+//Creates the lines and obstacles from the last image captured by the dcmi
+void process_last_image(void)
+{
+	//Gets the pointer to the array filled with the last image in RGB565
+	uint8_t *img_buff_ptr = dcmi_get_last_image_ptr();
+
+	//Extracts only the red pixels
+	for(uint16_t i = 0 ; i < (2 * IMAGE_BUFFER_SIZE) ; i+=2)
+	{
+		//Extracts first 5bits of the first byte (RGB565 Format)
+		image_red[i/2] = (uint8_t)img_buff_ptr[i]&0xF8;
+	}
+
+	//Extracts lines from the camera data
+	extract_lines(image_red);
+	//Extracts edges from the camera data and the line array
+	extract_edges(image_red);
+	//Builds a gate from edges (if available)
+	build_gate();
+	//Build a  goal from lines (if available)
+	build_goal();
+}
+
+
 //Image processing thread in charge of preparing the raw data and creating lines and obstacles
 static THD_WORKING_AREA(waProcessImage, 1024);
 static THD_FUNCTION(ProcessImage, arg)
@@ -271,9 +283,6 @@ static THD_FUNCTION(ProcessImage, arg)
     chRegSetThreadName(__FUNCTION__);
     (void)arg;
 
-	uint8_t *img_buff_ptr;
-	uint8_t image_red[IMAGE_BUFFER_SIZE] = {0};
-
 	//Initializes the arrays to zero
 	clear_all_lines();
 	clear_all_obstacles();
@@ -281,24 +290,8 @@ static THD_FUNCTION(ProcessImage, arg)
     while(1){
     	//Waits until an image has been captured
         chBSemWait(&image_ready_sem);
-		//Gets the pointer to the array filled with the last image in RGB565
-		img_buff_ptr = dcmi_get_last_image_ptr();
-
-		//Extracts only the red pixels
-		for(uint16_t i = 0 ; i < (2 * IMAGE_BUFFER_SIZE) ; i+=2)
-		{
-			//Extracts first 5bits of the first byte (RGB565 Format)
-			image_red[i/2] = (uint8_t)img_buff_ptr[i]&0xF8;
-		}
-
-		//Extracts lines from the camera data
-		extract_lines(image_red);
-		//Extracts edges from the camera data and the line array
-		extract_edges(image_red);
-		//Builds a gate from edges (if available)
-		build_gate();
-		//Build a  goal from lines (if available)
-		build_goal();
+		//Processes it
+		process_last_image();
     }
 }
 
@@ -317,6 +310,14 @@ uint16_t get_obstacle_pos(void)
 }
 
 
+//Copies the lines and obstacles registered from the last image, MAX_OBJECTS of each
+void get_image_objects(struct line *lines, struct obstacle *obstacles)
+{
+	memcpy(lines, current_lines, sizeof(current_lines));
+	memcpy(obstacles, current_obstacles, sizeof(current_obstacles));
+}
+
+
 //Starts the image capture and image processing threads
 void process_image_start(void)
 {
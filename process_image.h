@@ -19,12 +19,35 @@ Adapted from the code given in the EPFL MICRO-315 TP (Spring Semester 2020)
 #define GOAL					4
 #define UNKNOWN					5
 
+#define MAX_OBJECTS				5		//Maximum objects in the line and obstacle arrays
+
+//Line structure
+struct line {
+	bool exist;
+	uint16_t start;
+	uint16_t end;
+	uint16_t pos;
+	uint16_t meanval;
+};
+
+//Obstacle structure
+struct obstacle{
+	uint8_t type;
+	uint16_t pos;
+};
+
 //Returns the type of the obstacle in the 0th index of the array, considered the currently seen obstacle, to external modules
 uint8_t get_obstacle_type(void);
 
 //Returns the position of the obstacle in the 0th index of the array, considered the currently seen obstacle, to external modules
 uint16_t get_obstacle_pos(void);
 
+//Creates the lines and obstacles from the last image captured by the dcmi, called by the image processing thread
+void process_last_image(void);
+
+//Copies the lines and obstacles registered from the last image, MAX_OBJECTS of each
+void get_image_objects(struct line *lines, struct obstacle *obstacles);
+
 //Starts the image capture and image processing threads
 void process_image_start(void);
 